@@ -0,0 +1,348 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "DisplayFeature"
+
+#include "DisplayFeature.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <xf86drm.h>
+
+#include <algorithm>
+#include <sstream>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace displayfeature_aidl {
+
+namespace {
+
+constexpr const char* kDrmPath = "/dev/dri/card0";
+
+// Used when there is no vblank to wait for, e.g. with the panel off
+constexpr auto kFallbackVsyncPeriod = microseconds(8333);
+constexpr auto kVsyncTimeout = milliseconds(34);
+
+// Callback caseId for sendRefreshCommand, the other commands pass their own id
+constexpr int32_t kRefreshCaseId = -1;
+
+const char* commandTypeName(size_t type) {
+    static const char* const kNames[] = {
+            "brightness", "panel", "post proc", "feature", "function", "refresh",
+    };
+    return kNames[type];
+}
+
+}  // anonymous namespace
+
+DisplayFeature::DisplayFeature(std::unique_ptr<PanelBackend> panel)
+    : mPanel(std::move(panel)),
+      mModeController(mPanel.get(), DisplayModeController::featureIdsFromProperties()) {
+    mDrmFd.reset(TEMP_FAILURE_RETRY(open(kDrmPath, O_RDWR | O_CLOEXEC)));
+    if (!mDrmFd.ok()) {
+        PLOG(WARNING) << "Failed to open " << kDrmPath << ", pacing commands with a timer";
+    }
+
+    mWorker = std::thread(&DisplayFeature::workerThread, this);
+}
+
+DisplayFeature::~DisplayFeature() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCv.notify_all();
+    mWorker.join();
+}
+
+::ndk::ScopedAStatus DisplayFeature::notifyBrightness(int32_t brightness) {
+    enqueue(CommandType::BRIGHTNESS, 0, {brightness, 0, 0});
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus DisplayFeature::registerCallback(
+        int32_t displayId, const std::shared_ptr<IDisplayFeatureCallback>& callback) {
+    if (!callback) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_NULL_POINTER);
+    }
+
+    std::lock_guard<std::mutex> lock(mCallbackLock);
+    mCallbacks.emplace_back(displayId, callback);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus DisplayFeature::sendMessage(int32_t messageId, int32_t param,
+                                                 const std::string& message) {
+    LOG(DEBUG) << "Ignoring message " << messageId << " (" << param << ", " << message << ")";
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus DisplayFeature::sendPanelCommand(const std::string& command) {
+    enqueue(CommandType::PANEL, 0, {}, command);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus DisplayFeature::sendPostProcCommand(int32_t commandId, int32_t param) {
+    enqueue(CommandType::POST_PROC, commandId, {param, 0, 0});
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus DisplayFeature::sendRefreshCommand() {
+    enqueue(CommandType::REFRESH, 0, {});
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus DisplayFeature::setFeature(int32_t featureId, int32_t param1,
+                                                int32_t param2, int32_t param3) {
+    // The UDFPS scan waits on this one, don't hold it back until the next vsync
+    if (mModeController.isFodHbmFeature(featureId)) {
+        mModeController.setFodHbm(param1 != 0);
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    enqueue(CommandType::FEATURE, featureId, {param1, param2, param3});
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus DisplayFeature::setFunction(int32_t functionId, int32_t param1,
+                                                 int32_t param2, int32_t param3) {
+    enqueue(CommandType::FUNCTION, functionId, {param1, param2, param3});
+    return ::ndk::ScopedAStatus::ok();
+}
+
+/*
+ * A command replaces a pending one with the same type and id, so a brightness ramp only
+ * reaches the panel with the value current at each vsync. Features and functions carry their
+ * sub-command in param1 and are only coalesced with the same one.
+ */
+void DisplayFeature::enqueue(CommandType type, int32_t id, std::array<int32_t, 3> params,
+                             std::string text) {
+    Command command = {
+            .type = type,
+            .id = id,
+            .params = params,
+            .text = std::move(text),
+            .enqueueTime = steady_clock::now(),
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        command.sequence = mNextSequence++;
+
+        auto& stats = mStats[static_cast<size_t>(type)];
+        stats.submitted++;
+
+        if (type == CommandType::PANEL) {
+            mPendingPanel.push_back(std::move(command));
+        } else {
+            int32_t subCommand =
+                    type == CommandType::FEATURE || type == CommandType::FUNCTION ? params[0] : 0;
+            auto [it, inserted] =
+                    mPending.insert_or_assign({type, id, subCommand}, std::move(command));
+            if (!inserted) {
+                stats.coalesced++;
+            }
+        }
+    }
+
+    mCv.notify_one();
+}
+
+void DisplayFeature::notifyCallbacks(int32_t caseId, int32_t modeId, int32_t cookie) {
+    std::vector<std::pair<int32_t, std::shared_ptr<IDisplayFeatureCallback>>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mCallbackLock);
+        callbacks = mCallbacks;
+    }
+
+    std::vector<IDisplayFeatureCallback*> dead;
+    for (const auto& [displayId, callback] : callbacks) {
+        float result;
+        auto status = callback->displayfeatureInfoChanged(displayId, caseId, modeId, cookie,
+                                                          &result);
+        if (!status.isOk()) {
+            LOG(ERROR) << "Failed to notify callback for display " << displayId;
+            dead.push_back(callback.get());
+        }
+    }
+
+    if (!dead.empty()) {
+        std::lock_guard<std::mutex> lock(mCallbackLock);
+        std::erase_if(mCallbacks, [&dead](const auto& entry) {
+            return std::find(dead.begin(), dead.end(), entry.second.get()) != dead.end();
+        });
+    }
+}
+
+/*
+ * Everything but brightness and raw panel commands is also reported to the callbacks once the
+ * panel has it. A callback failing doesn't fail the command.
+ */
+bool DisplayFeature::applyCommand(const Command& command) {
+    bool applied = false;
+
+    switch (command.type) {
+        case CommandType::BRIGHTNESS:
+            return mPanel->setBrightness(command.params[0]);
+        case CommandType::PANEL:
+            return mPanel->sendPanelCommand(command.text);
+        case CommandType::POST_PROC:
+            applied = mPanel->sendPostProcCommand(command.id, command.params[0]);
+            break;
+        case CommandType::FEATURE:
+            if (mModeController.handlesFeature(command.id)) {
+                return mModeController.setFeature(command.id, command.params[0]);
+            }
+            applied = mPanel->setFeature(command.id, command.params);
+            break;
+        case CommandType::FUNCTION:
+            applied = mPanel->setFunction(command.id, command.params);
+            break;
+        case CommandType::REFRESH:
+            applied = mPanel->refresh();
+            break;
+        case CommandType::COUNT:
+            return false;
+    }
+
+    if (applied) {
+        if (command.type == CommandType::REFRESH) {
+            notifyCallbacks(kRefreshCaseId, 0, 0);
+        } else {
+            notifyCallbacks(command.id, command.params[0], command.params[1]);
+        }
+    }
+
+    return applied;
+}
+
+/*
+ * Waits for the next vblank through a DRM event, so a missing vblank (panel off) can't stall
+ * the queue for longer than kVsyncTimeout.
+ */
+void DisplayFeature::waitForVsync() {
+    if (mDrmFd.ok()) {
+        drmVBlank vbl = {};
+        vbl.request.type = static_cast<drmVBlankSeqType>(DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT);
+        vbl.request.sequence = 1;
+
+        if (drmWaitVBlank(mDrmFd.get(), &vbl) == 0) {
+            struct pollfd pfd = {.fd = mDrmFd.get(), .events = POLLIN};
+            int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, kVsyncTimeout.count()));
+            if (ret > 0) {
+                drmEventContext context = {.version = 2};
+                drmHandleEvent(mDrmFd.get(), &context);
+                std::lock_guard<std::mutex> lock(mLock);
+                mVsyncs++;
+                return;
+            }
+        }
+    }
+
+    std::this_thread::sleep_for(kFallbackVsyncPeriod);
+    std::lock_guard<std::mutex> lock(mLock);
+    mVsyncTimeouts++;
+}
+
+void DisplayFeature::workerThread() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (true) {
+        mCv.wait(lock, [this] { return mExit || !mPending.empty() || !mPendingPanel.empty(); });
+        if (mExit) {
+            return;
+        }
+
+        // Let the rest of the frame's commands arrive and coalesce
+        lock.unlock();
+        waitForVsync();
+        lock.lock();
+
+        std::vector<Command> commands = std::move(mPendingPanel);
+        mPendingPanel.clear();
+        for (auto& [key, command] : mPending) {
+            commands.push_back(std::move(command));
+        }
+        mPending.clear();
+
+        // Keep the order the commands were last submitted in
+        std::sort(commands.begin(), commands.end(),
+                  [](const Command& a, const Command& b) { return a.sequence < b.sequence; });
+
+        lock.unlock();
+        std::vector<bool> results;
+        results.reserve(commands.size());
+        for (const auto& command : commands) {
+            results.push_back(applyCommand(command));
+        }
+        // All mode changes of this vsync go out as a single transition
+        mModeController.commit();
+        auto now = steady_clock::now();
+        lock.lock();
+
+        for (size_t i = 0; i < commands.size(); i++) {
+            auto& stats = mStats[static_cast<size_t>(commands[i].type)];
+            if (!results[i]) {
+                stats.failed++;
+                continue;
+            }
+
+            stats.applied++;
+            auto latency = now - commands[i].enqueueTime;
+            auto bucket = std::find_if(kLatencyBuckets.begin(), kLatencyBuckets.end(),
+                                       [latency](auto bound) { return latency < bound; });
+            stats.histogram[bucket - kLatencyBuckets.begin()]++;
+        }
+    }
+}
+
+binder_status_t DisplayFeature::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    std::ostringstream stream;
+    stream << "DisplayFeature:" << std::endl;
+    stream << "  Vsync source: " << (mDrmFd.ok() ? "drm" : "timer") << ", vsyncs: " << mVsyncs
+           << ", timeouts: " << mVsyncTimeouts << std::endl;
+    stream << "  Pending: " << mPending.size() + mPendingPanel.size() << std::endl;
+
+    stream << "  Latency buckets (us):";
+    for (auto bound : kLatencyBuckets) {
+        stream << " <" << bound.count();
+    }
+    stream << " >=" << kLatencyBuckets.back().count() << std::endl;
+
+    for (size_t type = 0; type < mStats.size(); type++) {
+        const auto& stats = mStats[type];
+        stream << "  " << commandTypeName(type) << ": submitted " << stats.submitted
+               << ", coalesced " << stats.coalesced << ", applied " << stats.applied
+               << ", failed " << stats.failed << std::endl;
+        stream << "   ";
+        for (uint64_t count : stats.histogram) {
+            stream << " " << count;
+        }
+        stream << std::endl;
+    }
+
+    mModeController.dump(stream);
+
+    ::android::base::WriteStringToFd(stream.str(), fd);
+    return STATUS_OK;
+}
+
+}  // namespace displayfeature_aidl
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
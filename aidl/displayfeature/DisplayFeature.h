@@ -0,0 +1,123 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "DisplayModeController.h"
+#include "PanelBackend.h"
+
+#include <aidl/vendor/xiaomi/hardware/displayfeature_aidl/BnDisplayFeature.h>
+#include <android-base/unique_fd.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace displayfeature_aidl {
+
+class DisplayFeature : public BnDisplayFeature {
+  public:
+    DisplayFeature(std::unique_ptr<PanelBackend> panel);
+    ~DisplayFeature();
+
+    ::ndk::ScopedAStatus notifyBrightness(int32_t brightness) override;
+    ::ndk::ScopedAStatus registerCallback(
+            int32_t displayId, const std::shared_ptr<IDisplayFeatureCallback>& callback) override;
+    ::ndk::ScopedAStatus sendMessage(int32_t messageId, int32_t param,
+                                     const std::string& message) override;
+    ::ndk::ScopedAStatus sendPanelCommand(const std::string& command) override;
+    ::ndk::ScopedAStatus sendPostProcCommand(int32_t commandId, int32_t param) override;
+    ::ndk::ScopedAStatus sendRefreshCommand() override;
+    ::ndk::ScopedAStatus setFeature(int32_t featureId, int32_t param1, int32_t param2,
+                                    int32_t param3) override;
+    ::ndk::ScopedAStatus setFunction(int32_t functionId, int32_t param1, int32_t param2,
+                                     int32_t param3) override;
+
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+  private:
+    enum class CommandType {
+        BRIGHTNESS,
+        PANEL,
+        POST_PROC,
+        FEATURE,
+        FUNCTION,
+        REFRESH,
+        COUNT,
+    };
+
+    struct Command {
+        CommandType type;
+        int32_t id;
+        std::array<int32_t, 3> params;
+        std::string text;
+        uint64_t sequence = 0;
+        std::chrono::steady_clock::time_point enqueueTime;
+    };
+
+    // Upper bounds of the latency histogram buckets, the last bucket is open ended
+    static constexpr std::array<std::chrono::microseconds, 8> kLatencyBuckets = {
+            std::chrono::microseconds(250),   std::chrono::microseconds(500),
+            std::chrono::microseconds(1000),  std::chrono::microseconds(2000),
+            std::chrono::microseconds(4000),  std::chrono::microseconds(8000),
+            std::chrono::microseconds(16000), std::chrono::microseconds(32000),
+    };
+
+    struct CommandStats {
+        uint64_t submitted = 0;
+        uint64_t coalesced = 0;
+        uint64_t applied = 0;
+        uint64_t failed = 0;
+        std::array<uint64_t, kLatencyBuckets.size() + 1> histogram = {};
+    };
+
+    void enqueue(CommandType type, int32_t id, std::array<int32_t, 3> params,
+                 std::string text = {});
+    bool applyCommand(const Command& command);
+    void notifyCallbacks(int32_t caseId, int32_t modeId, int32_t cookie);
+    void waitForVsync();
+    void workerThread();
+
+    std::unique_ptr<PanelBackend> mPanel;
+    DisplayModeController mModeController;
+
+    // Only touched by the worker thread
+    ::android::base::unique_fd mDrmFd;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    // Latest command per (type, id, sub-command), everything but panel commands is coalesced
+    std::map<std::tuple<CommandType, int32_t, int32_t>, Command> mPending;
+    // Raw panel commands, applied in order
+    std::vector<Command> mPendingPanel;
+    uint64_t mNextSequence = 0;
+    bool mExit = false;
+
+    // Statistics, guarded by mLock
+    std::array<CommandStats, static_cast<size_t>(CommandType::COUNT)> mStats;
+    uint64_t mVsyncs = 0;
+    uint64_t mVsyncTimeouts = 0;
+
+    std::mutex mCallbackLock;
+    std::vector<std::pair<int32_t, std::shared_ptr<IDisplayFeatureCallback>>> mCallbacks;
+
+    std::thread mWorker;
+};
+
+}  // namespace displayfeature_aidl
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
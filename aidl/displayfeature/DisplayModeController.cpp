@@ -0,0 +1,231 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "DisplayFeature"
+
+#include "DisplayModeController.h"
+
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+
+#include <algorithm>
+
+using ::android::base::GetIntProperty;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace displayfeature_aidl {
+
+namespace {
+
+// disp_param values understood by the Xiaomi panel driver
+constexpr const char* kHbmOn = "0x10000";
+constexpr const char* kHbmFodOn = "0x20000";
+constexpr const char* kDcOn = "0x40000";
+constexpr const char* kDcOff = "0x50000";
+constexpr const char* kHbmFodOff = "0xE0000";
+constexpr const char* kHbmOff = "0xF0000";
+
+}  // anonymous namespace
+
+DisplayModeController::DisplayModeController(PanelBackend* panel, const FeatureIds& featureIds)
+    : mPanel(panel), mFeatureIds(featureIds) {
+    for (size_t from = 0; from < kNumStates; from++) {
+        for (size_t to = 0; to < kNumStates; to++) {
+            mTransitions[from][to] = buildTransition(stateFromIndex(from), stateFromIndex(to));
+        }
+    }
+}
+
+FeatureIds DisplayModeController::featureIdsFromProperties() {
+    constexpr const char* kPrefix = "ro.vendor.displayfeature.feature.";
+    return {
+            .panelMode = GetIntProperty<int32_t>(std::string(kPrefix) + "panel_mode", -1),
+            .hbm = GetIntProperty<int32_t>(std::string(kPrefix) + "hbm", -1),
+            .dcDimming = GetIntProperty<int32_t>(std::string(kPrefix) + "dc_dimming", -1),
+            .refreshRate = GetIntProperty<int32_t>(std::string(kPrefix) + "refresh_rate", -1),
+            .fodHbm = GetIntProperty<int32_t>(std::string(kPrefix) + "fod_hbm", -1),
+    };
+}
+
+size_t DisplayModeController::stateIndex(const DisplayModeState& state) {
+    constexpr size_t kHbmModes = static_cast<size_t>(HbmMode::COUNT);
+    return (static_cast<size_t>(state.panelMode) * kHbmModes + static_cast<size_t>(state.hbm)) *
+                   2 +
+           state.dcDimming;
+}
+
+DisplayModeState DisplayModeController::stateFromIndex(size_t index) {
+    constexpr size_t kHbmModes = static_cast<size_t>(HbmMode::COUNT);
+    return {
+            .panelMode = static_cast<PanelMode>(index / 2 / kHbmModes),
+            .hbm = static_cast<HbmMode>(index / 2 % kHbmModes),
+            .dcDimming = index % 2 == 1,
+    };
+}
+
+/*
+ * Resolves conflicts between requested modes: FOD HBM wins over everything and needs the panel
+ * out of doze, HBM and DC dimming don't mix, and neither applies while dozing.
+ */
+DisplayModeState DisplayModeController::effectiveState(const DisplayModeState& requested,
+                                                       bool fod) {
+    DisplayModeState state = requested;
+
+    if (fod) {
+        state.panelMode = PanelMode::NORMAL;
+        state.hbm = HbmMode::FOD;
+    } else if (state.panelMode == PanelMode::DOZE) {
+        state.hbm = HbmMode::OFF;
+    }
+
+    if (state.hbm != HbmMode::OFF || state.panelMode == PanelMode::DOZE) {
+        state.dcDimming = false;
+    }
+
+    return state;
+}
+
+/*
+ * Only modes that differ produce commands. FOD HBM goes first since it gates the UDFPS scan,
+ * DC dimming is turned off before and back on after any HBM change.
+ */
+std::vector<const char*> DisplayModeController::buildTransition(const DisplayModeState& from,
+                                                                const DisplayModeState& to) {
+    std::vector<const char*> commands;
+
+    if (from.hbm != HbmMode::FOD && to.hbm == HbmMode::FOD) {
+        commands.push_back(kHbmFodOn);
+    }
+
+    if (from.dcDimming && !to.dcDimming) {
+        commands.push_back(kDcOff);
+    }
+
+    if (from.hbm != to.hbm && to.hbm != HbmMode::FOD) {
+        if (from.hbm == HbmMode::FOD) {
+            commands.push_back(kHbmFodOff);
+        } else if (from.hbm == HbmMode::ON) {
+            commands.push_back(kHbmOff);
+        }
+
+        if (to.hbm == HbmMode::ON) {
+            commands.push_back(kHbmOn);
+        }
+    }
+
+    if (!from.dcDimming && to.dcDimming) {
+        commands.push_back(kDcOn);
+    }
+
+    return commands;
+}
+
+bool DisplayModeController::handlesFeature(int32_t featureId) const {
+    return featureId >= 0 &&
+           (featureId == mFeatureIds.panelMode || featureId == mFeatureIds.hbm ||
+            featureId == mFeatureIds.dcDimming || featureId == mFeatureIds.refreshRate);
+}
+
+bool DisplayModeController::setFeature(int32_t featureId, int32_t value) {
+    if (!handlesFeature(featureId)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (featureId == mFeatureIds.panelMode) {
+        if (value < 0 || value >= static_cast<int32_t>(PanelMode::COUNT)) {
+            return false;
+        }
+        mRequested.panelMode = static_cast<PanelMode>(value);
+    } else if (featureId == mFeatureIds.hbm) {
+        mRequested.hbm = value ? HbmMode::ON : HbmMode::OFF;
+    } else if (featureId == mFeatureIds.dcDimming) {
+        mRequested.dcDimming = value != 0;
+    } else {
+        // Switched by the composer, only tracked here
+        mRefreshRate = value;
+    }
+
+    return true;
+}
+
+bool DisplayModeController::commit() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return applyLocked();
+}
+
+bool DisplayModeController::isFodHbmFeature(int32_t featureId) const {
+    return featureId >= 0 && featureId == mFeatureIds.fodHbm;
+}
+
+bool DisplayModeController::setFodHbm(bool enabled) {
+    const auto start = steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mLock);
+    const bool wasEnabled = mFodHbm;
+    mFodHbm = enabled;
+    bool success = applyLocked();
+
+    if (enabled && !wasEnabled) {
+        auto elapsed = steady_clock::now() - start;
+        mFodEnters++;
+        mTotalFodEnterTime += elapsed;
+        mMaxFodEnterTime = std::max<std::chrono::nanoseconds>(mMaxFodEnterTime, elapsed);
+    }
+
+    return success;
+}
+
+bool DisplayModeController::applyLocked() {
+    DisplayModeState target = effectiveState(mRequested, mFodHbm);
+    if (target == mCurrent) {
+        return true;
+    }
+
+    const auto& commands = mTransitions[stateIndex(mCurrent)][stateIndex(target)];
+    mTransitionCount++;
+
+    for (const char* command : commands) {
+        if (!mPanel->sendPanelCommand(command)) {
+            // Retry the whole transition on the next change rather than guess the panel state
+            mFailures++;
+            return false;
+        }
+        mCommandsWritten++;
+    }
+
+    mCurrent = target;
+    return true;
+}
+
+void DisplayModeController::dump(std::ostream& stream) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    stream << "  Mode controller:" << std::endl;
+    stream << "    Current: panel mode " << static_cast<int>(mCurrent.panelMode) << ", hbm "
+           << static_cast<int>(mCurrent.hbm) << ", dc dimming " << mCurrent.dcDimming
+           << ", refresh rate " << mRefreshRate << std::endl;
+    stream << "    Transitions: " << mTransitionCount << ", commands: " << mCommandsWritten
+           << ", failures: " << mFailures << std::endl;
+
+    if (mFodEnters > 0) {
+        stream << "    FOD HBM enters: " << mFodEnters << ", latency avg: "
+               << duration_cast<microseconds>(mTotalFodEnterTime / mFodEnters).count()
+               << " us, max: " << duration_cast<microseconds>(mMaxFodEnterTime).count() << " us"
+               << std::endl;
+    }
+}
+
+}  // namespace displayfeature_aidl
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
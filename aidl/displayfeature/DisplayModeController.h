@@ -0,0 +1,113 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "PanelBackend.h"
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace displayfeature_aidl {
+
+/*
+ * setFeature ids handled by DisplayModeController, param1 carries the value. They differ between
+ * Xiaomi platforms, so each comes from ro.vendor.displayfeature.feature.<name>. A feature without
+ * an id (-1) is left to the registered callbacks.
+ */
+struct FeatureIds {
+    int32_t panelMode = -1;    // PanelMode, reported by the platform
+    int32_t hbm = -1;          // 0 or 1
+    int32_t dcDimming = -1;    // 0 or 1
+    int32_t refreshRate = -1;  // Hz, reported by the platform
+    int32_t fodHbm = -1;       // 0 or 1, sent by the fingerprint HAL and applied synchronously
+};
+
+enum class PanelMode : uint8_t {
+    NORMAL,
+    DOZE,
+    COUNT,
+};
+
+enum class HbmMode : uint8_t {
+    OFF,
+    ON,
+    FOD,
+    COUNT,
+};
+
+struct DisplayModeState {
+    PanelMode panelMode = PanelMode::NORMAL;
+    HbmMode hbm = HbmMode::OFF;
+    bool dcDimming = false;
+
+    bool operator==(const DisplayModeState& other) const = default;
+};
+
+/*
+ * Tracks panel mode, HBM and DC dimming as a state machine. The panel command sequence between
+ * any two states is built once at startup, so a mode change only writes what differs.
+ */
+class DisplayModeController {
+  public:
+    DisplayModeController(PanelBackend* panel, const FeatureIds& featureIds);
+
+    static FeatureIds featureIdsFromProperties();
+
+    bool handlesFeature(int32_t featureId) const;
+    // Updates the requested state, commit() takes the panel there in one transition
+    bool setFeature(int32_t featureId, int32_t value);
+    bool commit();
+
+    bool isFodHbmFeature(int32_t featureId) const;
+    // Fast path for the fingerprint HAL, doesn't wait for the next vsync
+    bool setFodHbm(bool enabled);
+
+    void dump(std::ostream& stream);
+
+  private:
+    static constexpr size_t kNumStates = static_cast<size_t>(PanelMode::COUNT) *
+                                         static_cast<size_t>(HbmMode::COUNT) * 2;
+
+    static size_t stateIndex(const DisplayModeState& state);
+    static DisplayModeState stateFromIndex(size_t index);
+    static DisplayModeState effectiveState(const DisplayModeState& requested, bool fod);
+    static std::vector<const char*> buildTransition(const DisplayModeState& from,
+                                                    const DisplayModeState& to);
+
+    bool applyLocked();
+
+    PanelBackend* mPanel;
+    const FeatureIds mFeatureIds;
+    // Command sequences indexed by [from][to] state index
+    std::array<std::array<std::vector<const char*>, kNumStates>, kNumStates> mTransitions;
+
+    std::mutex mLock;
+    DisplayModeState mRequested;
+    bool mFodHbm = false;
+    DisplayModeState mCurrent;
+    int32_t mRefreshRate = 0;
+
+    // Statistics, guarded by mLock
+    uint64_t mTransitionCount = 0;
+    uint64_t mCommandsWritten = 0;
+    uint64_t mFailures = 0;
+    uint64_t mFodEnters = 0;
+    std::chrono::nanoseconds mTotalFodEnterTime{0};
+    std::chrono::nanoseconds mMaxFodEnterTime{0};
+};
+
+}  // namespace displayfeature_aidl
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
@@ -0,0 +1,121 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "DisplayFeature"
+
+#include "PanelBackend.h"
+#include "mi_disp.h"
+
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace displayfeature_aidl {
+
+namespace {
+
+constexpr const char* kDefaultPanelPath = "/sys/devices/virtual/mi_display/disp_feature/disp-DSI-0";
+
+::android::base::unique_fd openNode(const std::string& path) {
+    ::android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CLOEXEC)));
+    if (!fd.ok()) {
+        PLOG(ERROR) << "Failed to open " << path;
+    }
+    return fd;
+}
+
+bool writeNode(const ::android::base::unique_fd& fd, const std::string& value) {
+    if (!fd.ok()) {
+        return false;
+    }
+
+    if (TEMP_FAILURE_RETRY(pwrite(fd.get(), value.data(), value.size(), 0)) !=
+        static_cast<ssize_t>(value.size())) {
+        PLOG(ERROR) << "Failed to write " << value << " to panel";
+        return false;
+    }
+
+    return true;
+}
+
+}  // anonymous namespace
+
+SysfsPanelBackend::SysfsPanelBackend() {
+    const std::string panelPath =
+            ::android::base::GetProperty("ro.vendor.displayfeature.panel_path", kDefaultPanelPath);
+
+    mBrightnessFd = openNode(panelPath + "/brightness_clone");
+    mDispParamFd = openNode(panelPath + "/disp_param");
+
+    mDispFeatureFd.reset(TEMP_FAILURE_RETRY(open(MI_DISP_FEATURE_DEV_PATH, O_RDWR | O_CLOEXEC)));
+    if (!mDispFeatureFd.ok()) {
+        PLOG(ERROR) << "Failed to open " << MI_DISP_FEATURE_DEV_PATH;
+    }
+}
+
+bool SysfsPanelBackend::setBrightness(int32_t brightness) {
+    return writeNode(mBrightnessFd, std::to_string(brightness));
+}
+
+bool SysfsPanelBackend::sendPanelCommand(const std::string& command) {
+    return writeNode(mDispParamFd, command);
+}
+
+/*
+ * The driver takes every panel request but raw commands and brightness through one feature
+ * ioctl, telling them apart by id. Parameters past the value go in the tx buffer.
+ */
+bool SysfsPanelBackend::sendFeatureRequest(int32_t featureId, int32_t value,
+                                           std::vector<int32_t> extra) {
+    if (!mDispFeatureFd.ok()) {
+        return false;
+    }
+
+    struct disp_feature_req req = {};
+    req.base.disp_id = MI_DISP_PRIMARY;
+    req.feature_id = featureId;
+    req.feature_val = value;
+    req.tx_len = extra.size() * sizeof(int32_t);
+    req.tx_ptr = reinterpret_cast<uintptr_t>(extra.data());
+
+    if (ioctl(mDispFeatureFd.get(), MI_DISP_IOCTL_SET_FEATURE, &req) < 0) {
+        PLOG(ERROR) << "Failed to set panel feature " << featureId << " to " << value;
+        return false;
+    }
+
+    return true;
+}
+
+bool SysfsPanelBackend::sendPostProcCommand(int32_t commandId, int32_t param) {
+    return sendFeatureRequest(commandId, param, {});
+}
+
+bool SysfsPanelBackend::setFeature(int32_t featureId, const std::array<int32_t, 3>& params) {
+    return sendFeatureRequest(featureId, params[0], {params[1], params[2]});
+}
+
+bool SysfsPanelBackend::setFunction(int32_t functionId, const std::array<int32_t, 3>& params) {
+    return sendFeatureRequest(functionId, params[0], {params[1], params[2]});
+}
+
+/*
+ * The panel picks feature and disp_param changes up on its next frame by itself, there is
+ * nothing to kick. The composer is asked to redraw through the callbacks.
+ */
+bool SysfsPanelBackend::refresh() {
+    return true;
+}
+
+}  // namespace displayfeature_aidl
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace displayfeature_aidl {
+
+/*
+ * Where DisplayFeature commands that touch the panel end up.
+ */
+class PanelBackend {
+  public:
+    virtual ~PanelBackend() = default;
+
+    virtual bool setBrightness(int32_t brightness) = 0;
+    virtual bool sendPanelCommand(const std::string& command) = 0;
+    virtual bool sendPostProcCommand(int32_t commandId, int32_t param) = 0;
+    virtual bool setFeature(int32_t featureId, const std::array<int32_t, 3>& params) = 0;
+    virtual bool setFunction(int32_t functionId, const std::array<int32_t, 3>& params) = 0;
+    virtual bool refresh() = 0;
+};
+
+/*
+ * mi_disp sysfs nodes and feature device of the primary panel, kept open for the lifetime of
+ * the service.
+ */
+class SysfsPanelBackend : public PanelBackend {
+  public:
+    SysfsPanelBackend();
+
+    bool setBrightness(int32_t brightness) override;
+    bool sendPanelCommand(const std::string& command) override;
+    bool sendPostProcCommand(int32_t commandId, int32_t param) override;
+    bool setFeature(int32_t featureId, const std::array<int32_t, 3>& params) override;
+    bool setFunction(int32_t functionId, const std::array<int32_t, 3>& params) override;
+    bool refresh() override;
+
+  private:
+    bool sendFeatureRequest(int32_t featureId, int32_t value, std::vector<int32_t> extra);
+
+    ::android::base::unique_fd mBrightnessFd;
+    ::android::base::unique_fd mDispParamFd;
+    ::android::base::unique_fd mDispFeatureFd;
+};
+
+}  // namespace displayfeature_aidl
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
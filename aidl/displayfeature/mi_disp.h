@@ -0,0 +1,33 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+// Userspace ABI of the mi_disp driver's feature device, the subset DisplayFeature uses.
+
+#define MI_DISP_FEATURE_DEV_PATH "/dev/mi_display/disp_feature"
+
+#define MI_DISP_PRIMARY 0
+
+struct disp_base {
+    __u32 flag;
+    __u32 disp_id;
+};
+
+struct disp_feature_req {
+    struct disp_base base;
+    __u32 feature_id;
+    __s32 feature_val;
+    __u32 tx_len;
+    __u64 tx_ptr;
+    __u32 rx_len;
+    __u64 rx_ptr;
+};
+
+#define MI_DISP_IOCTL_MAGIC 'D'
+#define MI_DISP_IOCTL_SET_FEATURE _IOWR(MI_DISP_IOCTL_MAGIC, 0x01, struct disp_feature_req)
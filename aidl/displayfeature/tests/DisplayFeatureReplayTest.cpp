@@ -0,0 +1,279 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <aidl/vendor/xiaomi/hardware/displayfeature_aidl/BnDisplayFeatureCallback.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DisplayFeature.h"
+
+using aidl::vendor::xiaomi::hardware::displayfeature_aidl::BnDisplayFeatureCallback;
+using aidl::vendor::xiaomi::hardware::displayfeature_aidl::DisplayFeature;
+using aidl::vendor::xiaomi::hardware::displayfeature_aidl::PanelBackend;
+
+namespace {
+
+constexpr auto kApplyTimeout = std::chrono::seconds(2);
+
+/*
+ * Records everything that reaches the panel as one ordered log. hold() blocks the worker in
+ * its next panel call until release(), so a trace can be queued up in full behind it and the
+ * outcome doesn't depend on vsync timing.
+ */
+class FakePanelBackend : public PanelBackend {
+  public:
+    bool setBrightness(int32_t brightness) override {
+        return record("brightness " + std::to_string(brightness));
+    }
+
+    bool sendPanelCommand(const std::string& command) override {
+        return record("panel " + command);
+    }
+
+    bool sendPostProcCommand(int32_t commandId, int32_t param) override {
+        return record("postproc " + std::to_string(commandId) + " " + std::to_string(param));
+    }
+
+    bool setFeature(int32_t featureId, const std::array<int32_t, 3>& params) override {
+        return record("feature " + std::to_string(featureId) + " " + join(params));
+    }
+
+    bool setFunction(int32_t functionId, const std::array<int32_t, 3>& params) override {
+        return record("function " + std::to_string(functionId) + " " + join(params));
+    }
+
+    bool refresh() override { return record("refresh"); }
+
+    void hold() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mHold = true;
+    }
+
+    bool waitUntilHeld() {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCv.wait_for(lock, kApplyTimeout, [&] { return mHeld; });
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mHold = false;
+        mCv.notify_all();
+    }
+
+    bool waitForEntries(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCv.wait_for(lock, kApplyTimeout, [&] { return mLog.size() >= count; });
+    }
+
+    std::vector<std::string> log() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mLog;
+    }
+
+  private:
+    static std::string join(const std::array<int32_t, 3>& params) {
+        return std::to_string(params[0]) + " " + std::to_string(params[1]) + " " +
+               std::to_string(params[2]);
+    }
+
+    bool record(std::string entry) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mLog.push_back(std::move(entry));
+        if (mHold) {
+            mHeld = true;
+            mCv.notify_all();
+            mCv.wait(lock, [&] { return !mHold; });
+            mHeld = false;
+        }
+        mCv.notify_all();
+        return true;
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    std::vector<std::string> mLog;
+    bool mHold = false;
+    bool mHeld = false;
+};
+
+class FakeCallback : public BnDisplayFeatureCallback {
+  public:
+    ::ndk::ScopedAStatus displayfeatureInfoChanged(int32_t /* displayId */, int32_t caseId,
+                                                   float modeId, float /* cookie */,
+                                                   float* _aidl_return) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEvents.emplace_back(caseId, static_cast<int32_t>(modeId));
+        mCv.notify_all();
+        *_aidl_return = 0;
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    bool waitForEvents(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCv.wait_for(lock, kApplyTimeout, [&] { return mEvents.size() >= count; });
+    }
+
+    std::vector<std::pair<int32_t, int32_t>> events() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mEvents;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCv;
+    std::vector<std::pair<int32_t, int32_t>> mEvents;
+};
+
+class DisplayFeatureReplayTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        auto panel = std::make_unique<FakePanelBackend>();
+        mPanel = panel.get();
+        mDisplayFeature = ::ndk::SharedRefBase::make<DisplayFeature>(std::move(panel));
+    }
+
+    // Parks the worker in a panel call, everything sent until release() lands in one batch
+    void holdWorker() {
+        mPanel->hold();
+        ASSERT_TRUE(mDisplayFeature->sendPanelCommand("hold").isOk());
+        ASSERT_TRUE(mPanel->waitUntilHeld());
+    }
+
+    FakePanelBackend* mPanel;
+    std::shared_ptr<DisplayFeature> mDisplayFeature;
+};
+
+}  // anonymous namespace
+
+TEST_F(DisplayFeatureReplayTest, BrightnessRampCoalescesToItsLastStep) {
+    holdWorker();
+
+    // A ramp as the framework sends it, all within one frame
+    for (int32_t brightness = 1; brightness <= 255; brightness++) {
+        ASSERT_TRUE(mDisplayFeature->notifyBrightness(brightness).isOk());
+    }
+    mPanel->release();
+
+    const std::vector<std::string> expected = {"panel hold", "brightness 255"};
+    ASSERT_TRUE(mPanel->waitForEntries(expected.size()));
+    EXPECT_EQ(mPanel->log(), expected);
+}
+
+TEST_F(DisplayFeatureReplayTest, PanelCommandsKeepTheirOrder) {
+    const std::vector<std::string> trace = {"0x10000", "0x40000", "0x50000", "0xF0000",
+                                            "0x10000"};
+    holdWorker();
+    for (const auto& command : trace) {
+        ASSERT_TRUE(mDisplayFeature->sendPanelCommand(command).isOk());
+    }
+    mPanel->release();
+
+    std::vector<std::string> expected = {"panel hold"};
+    for (const auto& command : trace) {
+        expected.push_back("panel " + command);
+    }
+    ASSERT_TRUE(mPanel->waitForEntries(expected.size()));
+    EXPECT_EQ(mPanel->log(), expected);
+}
+
+TEST_F(DisplayFeatureReplayTest, PostProcCommandsCoalescePerId) {
+    auto callback = ::ndk::SharedRefBase::make<FakeCallback>();
+    ASSERT_TRUE(mDisplayFeature->registerCallback(0, callback).isOk());
+
+    holdWorker();
+    for (int32_t param = 0; param < 100; param++) {
+        ASSERT_TRUE(mDisplayFeature->sendPostProcCommand(7, param).isOk());
+    }
+    mPanel->release();
+
+    const std::vector<std::string> expected = {"panel hold", "postproc 7 99"};
+    ASSERT_TRUE(mPanel->waitForEntries(expected.size()));
+    EXPECT_EQ(mPanel->log(), expected);
+
+    ASSERT_TRUE(callback->waitForEvents(1));
+    EXPECT_EQ(callback->events(), (std::vector<std::pair<int32_t, int32_t>>{{7, 99}}));
+}
+
+TEST_F(DisplayFeatureReplayTest, FeaturesCoalescePerSubCommand) {
+    holdWorker();
+    for (int32_t value = 0; value < 10; value++) {
+        ASSERT_TRUE(mDisplayFeature->setFeature(0, 20, value, 255).isOk());
+        ASSERT_TRUE(mDisplayFeature->setFeature(0, 10, 100 + value, 255).isOk());
+        ASSERT_TRUE(mDisplayFeature->setFunction(0, 3, value, 0).isOk());
+    }
+    ASSERT_TRUE(mDisplayFeature->sendRefreshCommand().isOk());
+    mPanel->release();
+
+    const std::vector<std::string> expected = {
+            "panel hold",
+            "feature 0 20 9 255",
+            "feature 0 10 109 255",
+            "function 0 3 9 0",
+            "refresh",
+    };
+    ASSERT_TRUE(mPanel->waitForEntries(expected.size()));
+    EXPECT_EQ(mPanel->log(), expected);
+}
+
+TEST_F(DisplayFeatureReplayTest, MixedTraceReachesItsFinalState) {
+    auto callback = ::ndk::SharedRefBase::make<FakeCallback>();
+    ASSERT_TRUE(mDisplayFeature->registerCallback(0, callback).isOk());
+
+    holdWorker();
+    for (int32_t step = 0; step < 50; step++) {
+        ASSERT_TRUE(mDisplayFeature->notifyBrightness(100 + step).isOk());
+        ASSERT_TRUE(mDisplayFeature->sendPostProcCommand(step % 3, step).isOk());
+        ASSERT_TRUE(mDisplayFeature->sendPanelCommand(std::to_string(step)).isOk());
+    }
+    mPanel->release();
+
+    // Raw panel commands all go out once and in order. Of the rest, only the last value of
+    // each id is applied, in the order those were submitted.
+    std::vector<std::string> expected = {"panel hold"};
+    for (int32_t step = 0; step < 47; step++) {
+        expected.push_back("panel " + std::to_string(step));
+    }
+    expected.insert(expected.end(), {
+                                            "postproc 2 47",
+                                            "panel 47",
+                                            "postproc 0 48",
+                                            "panel 48",
+                                            "brightness 149",
+                                            "postproc 1 49",
+                                            "panel 49",
+                                    });
+    ASSERT_TRUE(mPanel->waitForEntries(expected.size()));
+    EXPECT_EQ(mPanel->log(), expected);
+
+    ASSERT_TRUE(callback->waitForEvents(3));
+    EXPECT_EQ(callback->events(),
+              (std::vector<std::pair<int32_t, int32_t>>{{2, 47}, {0, 48}, {1, 49}}));
+}
+
+TEST(DisplayModeControllerTest, FodHbmIsAppliedRightAway) {
+    using aidl::vendor::xiaomi::hardware::displayfeature_aidl::DisplayModeController;
+
+    FakePanelBackend panel;
+    DisplayModeController controller(&panel, {.dcDimming = 1, .fodHbm = 2});
+    ASSERT_TRUE(controller.isFodHbmFeature(2));
+
+    ASSERT_TRUE(controller.setFeature(1, 1));
+    ASSERT_TRUE(controller.commit());
+
+    // Nothing to commit, FOD HBM goes out first and DC dimming comes back after it
+    ASSERT_TRUE(controller.setFodHbm(true));
+    ASSERT_TRUE(controller.setFodHbm(false));
+
+    const std::vector<std::string> expected = {
+            "panel 0x40000", "panel 0x20000", "panel 0x50000",
+            "panel 0xE0000", "panel 0x40000",
+    };
+    EXPECT_EQ(panel.log(), expected);
+}
@@ -11,9 +11,12 @@
 #include <fingerprint.sysprop.h>
 #include "util/Util.h"
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 
+#include <sstream>
+
 namespace aidl::android::hardware::biometrics::fingerprint {
 
 namespace {
@@ -25,6 +28,12 @@ constexpr char SERIAL_NUMBER[] = "00000001";
 constexpr char SW_COMPONENT_ID[] = "matchingAlgorithm";
 constexpr char SW_VERSION[] = "vendor/version/revision";
 
+// vendor.xiaomi.hardware.fingerprintextension commands
+constexpr int32_t COMMAND_FOD_PRESS_STATUS = 1;
+constexpr int32_t PARAM_FOD_PRESSED = 1;
+constexpr int32_t COMMAND_NIT = 10;
+constexpr int32_t PARAM_NIT_FOD = 1;
+
 typedef struct fingerprint_hal {
     const char* class_name;
 } fingerprint_hal_t;
@@ -67,6 +76,14 @@ Fingerprint::Fingerprint(std::shared_ptr<FingerprintConfig> config) : mConfig(st
             }
             ALOGI("Opened fingerprint HAL, class: %s, module_id: %s", class_name.c_str(),
                   class_module_id.c_str());
+            if (class_name == "goodix" || class_name == "goodix_fod") {
+                GoodixCommands commands = {
+                        .screenOn = mConfig->get<std::int32_t>("goodix_screen_on_cmd"),
+                        .screenOff = mConfig->get<std::int32_t>("goodix_screen_off_cmd"),
+                        .ffFeature = mConfig->get<std::int32_t>("goodix_ff_feature_cmd"),
+                };
+                mGoodixExtension = std::make_unique<GoodixExtension>(mDevice, commands);
+            }
             break;
         }
         if (!mDevice) {
@@ -92,6 +109,16 @@ Fingerprint::Fingerprint(std::shared_ptr<FingerprintConfig> config) : mConfig(st
                 mUdfpsHandler->init(mDevice);
             }
         }
+        auto locations = getSensorLocations();
+        if (!locations.empty()) {
+            mUdfpsLocation = locations.front();
+        }
+        if (mSensorType == FingerprintSensorType::UNDER_DISPLAY_OPTICAL) {
+            int32_t fodHbmFeature = FodHbm::featureIdFromProperties();
+            if (fodHbmFeature >= 0) {
+                mFodHbm = std::make_unique<FodHbm>(fodHbmFeature);
+            }
+        }
     } else if (sensorTypeProp == "side") {
         mSensorType = FingerprintSensorType::POWER_BUTTON;
     } else if (sensorTypeProp == "home") {
@@ -195,11 +222,20 @@ std::vector<SensorLocation> Fingerprint::getSensorLocations() {
 
 void Fingerprint::notify(const fingerprint_msg_t* msg) {
     Fingerprint* thisPtr = sInstance;
-    if (thisPtr == nullptr || thisPtr->mSession == nullptr || thisPtr->mSession->isClosed()) {
+    std::shared_ptr<Session> session = thisPtr ? thisPtr->getOpenSession() : nullptr;
+    if (session == nullptr) {
         ALOGE("Receiving callbacks before a session is opened.");
         return;
     }
-    thisPtr->mSession->notify(msg);
+    session->notify(msg);
+}
+
+std::shared_ptr<Session> Fingerprint::getOpenSession() {
+    std::lock_guard<std::mutex> lock(mSessionLock);
+    if (mSession == nullptr || mSession->isClosed()) {
+        return nullptr;
+    }
+    return mSession;
 }
 
 ndk::ScopedAStatus Fingerprint::getSensorProps(std::vector<SensorProps>* out) {
@@ -235,9 +271,11 @@ ndk::ScopedAStatus Fingerprint::getSensorProps(std::vector<SensorProps>* out) {
 ndk::ScopedAStatus Fingerprint::createSession(int32_t /*sensorId*/, int32_t userId,
                                               const std::shared_ptr<ISessionCallback>& cb,
                                               std::shared_ptr<ISession>* out) {
+    std::lock_guard<std::mutex> lock(mSessionLock);
     CHECK(mSession == nullptr || mSession->isClosed()) << "Open session already exists!";
 
-    mSession = SharedRefBase::make<Session>(mDevice, mUdfpsHandler, userId, cb, mLockoutTracker);
+    mSession = SharedRefBase::make<Session>(mDevice, mUdfpsHandler, mGoodixExtension.get(), userId,
+                                            cb, mLockoutTracker);
     *out = mSession;
 
     mSession->linkToDeath(cb->asBinder().get());
@@ -245,4 +283,74 @@ ndk::ScopedAStatus Fingerprint::createSession(int32_t /*sensorId*/, int32_t user
     return ndk::ScopedAStatus::ok();
 }
 
+binder_status_t Fingerprint::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    std::ostringstream stream;
+    stream << "Fingerprint:" << std::endl;
+    stream << "  Sensor type: " << ::android::internal::ToString(mSensorType) << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(mSessionLock);
+        stream << "  Session: "
+               << (mSession == nullptr ? "none" : (mSession->isClosed() ? "closed" : "open"))
+               << std::endl;
+    }
+    if (mGoodixExtension) {
+        mGoodixExtension->dump(stream);
+    }
+    if (mFodHbm) {
+        mFodHbm->dump(stream);
+    }
+
+    ::android::base::WriteStringToFd(stream.str(), fd);
+    return STATUS_OK;
+}
+
+int32_t Fingerprint::extCmd(int32_t cmd, int32_t param) {
+    switch (cmd) {
+        case COMMAND_FOD_PRESS_STATUS: {
+            // Optical sensors need the area lit before they can scan, session or not
+            if (mFodHbm) {
+                mFodHbm->setEnabled(param == PARAM_FOD_PRESSED);
+            }
+            if (!mUdfpsHandler) {
+                return 0;
+            }
+            // Through the session while one is open so it sees the press like any other
+            // pointer event, straight to the handler otherwise (e.g. on AOD).
+            auto session = getOpenSession();
+            if (param == PARAM_FOD_PRESSED) {
+                int32_t x = mUdfpsLocation ? mUdfpsLocation->sensorLocationX : 0;
+                int32_t y = mUdfpsLocation ? mUdfpsLocation->sensorLocationY : 0;
+                if (session) {
+                    session->onPointerDown(0, x, y, 0, 0);
+                } else {
+                    mUdfpsHandler->onFingerDown(x, y, 0, 0);
+                }
+            } else if (session) {
+                session->onPointerUp(0);
+            } else {
+                mUdfpsHandler->onFingerUp();
+            }
+            return 0;
+        }
+        case COMMAND_NIT:
+            if (param != PARAM_NIT_FOD || !mUdfpsHandler) {
+                return 0;
+            }
+            if (auto session = getOpenSession()) {
+                session->onUiReady();
+            } else {
+                mUdfpsHandler->onUiReady();
+            }
+            return 0;
+        default:
+            // Screen state, finger-fast and anything else goes to the vendor module, only
+            // Goodix ones implement goodixExtCmd.
+            if (mGoodixExtension) {
+                return mGoodixExtension->handleExtCmd(cmd, param);
+            }
+            ALOGW("Unhandled extCmd %d, param %d", cmd, param);
+            return -EINVAL;
+    }
+}
+
 }  // namespace aidl::android::hardware::biometrics::fingerprint
@@ -9,7 +9,12 @@
 
 #include <aidl/android/hardware/biometrics/fingerprint/BnFingerprint.h>
 
+#include <mutex>
+#include <optional>
+
 #include "FingerprintConfig.h"
+#include "FodHbm.h"
+#include "GoodixExtension.h"
 #include "LockoutTracker.h"
 #include "Session.h"
 #include "UdfpsHandler.h"
@@ -31,19 +36,31 @@ class Fingerprint : public BnFingerprint {
                                      const std::shared_ptr<ISessionCallback>& cb,
                                      std::shared_ptr<ISession>* out) override;
 
+    // Runs a vendor.xiaomi.hardware.fingerprintextension command against the live session.
+    int32_t extCmd(int32_t cmd, int32_t param);
+
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
   private:
     fingerprint_device_t* openFingerprintHal(const char* class_name, const char* module_id);
     std::vector<SensorLocation> getSensorLocations();
     static void notify(const fingerprint_msg_t* msg);
 
+    // The open session if any, extCmd and notify can race with createSession
+    std::shared_ptr<Session> getOpenSession();
+
     std::shared_ptr<FingerprintConfig> mConfig;
+    std::mutex mSessionLock;
     std::shared_ptr<Session> mSession;
     LockoutTracker mLockoutTracker;
     FingerprintSensorType mSensorType;
+    std::optional<SensorLocation> mUdfpsLocation;
 
     fingerprint_device_t* mDevice;
     UdfpsHandlerFactory* mUdfpsHandlerFactory;
     UdfpsHandler* mUdfpsHandler;
+    std::unique_ptr<GoodixExtension> mGoodixExtension;
+    std::unique_ptr<FodHbm> mFodHbm;
 };
 
 }  // namespace aidl::android::hardware::biometrics::fingerprint
@@ -34,6 +34,9 @@ CREATE_GETTER_SETTER_WRAPPER(navigation_gesture, OptBool)
 CREATE_GETTER_SETTER_WRAPPER(detect_interaction, OptBool)
 CREATE_GETTER_SETTER_WRAPPER(display_touch, OptBool)
 CREATE_GETTER_SETTER_WRAPPER(control_illumination, OptBool)
+CREATE_GETTER_SETTER_WRAPPER(goodix_screen_on_cmd, OptInt32)
+CREATE_GETTER_SETTER_WRAPPER(goodix_screen_off_cmd, OptInt32)
+CREATE_GETTER_SETTER_WRAPPER(goodix_ff_feature_cmd, OptInt32)
 
 // Name, Getter, Setter, Parser and default value
 #define NGS(_NAME_) #_NAME_, _NAME_##Getter, _NAME_##Setter
@@ -46,6 +49,9 @@ static Config::Data configData[] = {
         {NGS(detect_interaction), &Config::parseBool, "false"},
         {NGS(display_touch), &Config::parseBool, "false"},
         {NGS(control_illumination), &Config::parseBool, "false"},
+        {NGS(goodix_screen_on_cmd), &Config::parseInt32, "-1"},
+        {NGS(goodix_screen_off_cmd), &Config::parseInt32, "-1"},
+        {NGS(goodix_ff_feature_cmd), &Config::parseInt32, "-1"},
 };
 
 Config::Data* FingerprintConfig::getConfigData(int* size) {
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "android.hardware.biometrics.fingerprint-service.xiaomi"
+
+#include "FodHbm.h"
+
+#include <android-base/properties.h>
+#include <android/binder_manager.h>
+#include <log/log.h>
+
+#include <algorithm>
+
+namespace aidl::android::hardware::biometrics::fingerprint {
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+int32_t FodHbm::featureIdFromProperties() {
+    return ::android::base::GetIntProperty<int32_t>("ro.vendor.displayfeature.feature.fod_hbm",
+                                                    -1);
+}
+
+FodHbm::FodHbm(int32_t featureId) : mFeatureId(featureId) {}
+
+/*
+ * The display HAL may start after us or restart, so it is looked up without waiting on the
+ * first press that needs it and dropped again when a call fails.
+ */
+std::shared_ptr<FodHbm::IDisplayFeature> FodHbm::getDisplayFeature() {
+    if (!mDisplayFeature) {
+        const std::string instance = std::string(IDisplayFeature::descriptor) + "/default";
+        mDisplayFeature = IDisplayFeature::fromBinder(
+                ndk::SpAIBinder(AServiceManager_checkService(instance.c_str())));
+    }
+    return mDisplayFeature;
+}
+
+void FodHbm::setEnabled(bool enabled) {
+    const auto start = steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (enabled == mEnabled) {
+        return;
+    }
+
+    auto displayFeature = getDisplayFeature();
+    if (!displayFeature || !displayFeature->setFeature(mFeatureId, enabled, 0, 0).isOk()) {
+        ALOGE("Failed to %s FOD HBM", enabled ? "enable" : "disable");
+        mDisplayFeature.reset();
+        mFailures++;
+        return;
+    }
+    mEnabled = enabled;
+
+    if (enabled) {
+        auto elapsed = steady_clock::now() - start;
+        mEnters++;
+        mTotalEnterTime += elapsed;
+        mMaxEnterTime = std::max(mMaxEnterTime, elapsed);
+    }
+}
+
+void FodHbm::dump(std::ostream& stream) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    stream << "  FOD HBM: feature " << mFeatureId << ", " << (mEnabled ? "on" : "off")
+           << ", enters: " << mEnters << ", failures: " << mFailures << std::endl;
+    if (mEnters > 0) {
+        stream << "    Press to HBM latency avg: "
+               << duration_cast<microseconds>(mTotalEnterTime / mEnters).count()
+               << " us, max: " << duration_cast<microseconds>(mMaxEnterTime).count() << " us"
+               << std::endl;
+    }
+}
+
+}  // namespace aidl::android::hardware::biometrics::fingerprint
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/xiaomi/hardware/displayfeature_aidl/IDisplayFeature.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+namespace aidl::android::hardware::biometrics::fingerprint {
+
+// Lights the sensor area of optical UDFPS on a FOD press through the display HAL's FOD HBM
+// fast path, which skips its vsync queue.
+class FodHbm {
+  public:
+    // The display HAL's setFeature id for FOD HBM, -1 if the device has none
+    static int32_t featureIdFromProperties();
+
+    explicit FodHbm(int32_t featureId);
+
+    void setEnabled(bool enabled);
+    void dump(std::ostream& stream);
+
+  private:
+    using IDisplayFeature = ::aidl::vendor::xiaomi::hardware::displayfeature_aidl::IDisplayFeature;
+
+    std::shared_ptr<IDisplayFeature> getDisplayFeature();
+
+    const int32_t mFeatureId;
+
+    std::mutex mLock;
+    std::shared_ptr<IDisplayFeature> mDisplayFeature;
+    bool mEnabled = false;
+
+    uint64_t mEnters = 0;
+    uint64_t mFailures = 0;
+    std::chrono::steady_clock::duration mTotalEnterTime{};
+    std::chrono::steady_clock::duration mMaxEnterTime{};
+};
+
+}  // namespace aidl::android::hardware::biometrics::fingerprint
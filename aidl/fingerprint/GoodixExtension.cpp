@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "android.hardware.biometrics.fingerprint-service.xiaomi"
+
+#include "GoodixExtension.h"
+
+#include <android/binder_to_string.h>
+#include <log/log.h>
+
+namespace aidl::android::hardware::biometrics::fingerprint {
+
+using common::DisplayState;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+GoodixExtension::GoodixExtension(fingerprint_device_t* device, const GoodixCommands& commands)
+    : mDevice(device), mCommands(commands) {}
+
+void GoodixExtension::onDisplayStateChanged(DisplayState state) {
+    if (state == DisplayState::UNKNOWN) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (state == mState) {
+        return;
+    }
+    ALOGD("display state %s -> %s", ::android::internal::ToString(mState).c_str(),
+          ::android::internal::ToString(state).c_str());
+    mState = state;
+    mTransitions++;
+
+    // Keyguard, AOD and screensaver are where an unlock touch can land without any UI asking
+    // for it first, keep finger-fast armed there. The panel is dark for AOD and screensaver.
+    bool screenOnWanted = state == DisplayState::LOCKSCREEN || state == DisplayState::NO_UI;
+    bool ffWanted = state != DisplayState::NO_UI;
+
+    // Arm finger-fast before a screen off so there is no window where neither is active.
+    if (ffWanted && !mFfEnabled && enableFfFeature(true) == 0) {
+        mFfEnabled = true;
+    }
+    if (screenOnWanted != mScreenOn && (screenOnWanted ? screenOn() : screenOff()) == 0) {
+        mScreenOn = screenOnWanted;
+    }
+    if (!ffWanted && mFfEnabled && enableFfFeature(false) == 0) {
+        mFfEnabled = false;
+    }
+}
+
+int GoodixExtension::handleExtCmd(int32_t cmd, int32_t param) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (cmd >= 0 && (cmd == mCommands.screenOn || cmd == mCommands.screenOff)) {
+        bool screenOnWanted = cmd == mCommands.screenOn;
+        if (screenOnWanted == mScreenOn) {
+            return 0;
+        }
+        int ret = screenOnWanted ? screenOn() : screenOff();
+        if (ret == 0) {
+            mScreenOn = screenOnWanted;
+        }
+        return ret;
+    }
+
+    if (cmd >= 0 && cmd == mCommands.ffFeature) {
+        bool ffWanted = param != 0;
+        if (ffWanted == mFfEnabled) {
+            return 0;
+        }
+        int ret = enableFfFeature(ffWanted);
+        if (ret == 0) {
+            mFfEnabled = ffWanted;
+        }
+        return ret;
+    }
+
+    return extCmd(cmd, param);
+}
+
+int GoodixExtension::screenOn() {
+    return extCmd(mCommands.screenOn, 0);
+}
+
+int GoodixExtension::screenOff() {
+    return extCmd(mCommands.screenOff, 0);
+}
+
+int GoodixExtension::enableFfFeature(bool enable) {
+    return extCmd(mCommands.ffFeature, enable ? 1 : 0);
+}
+
+int GoodixExtension::extCmd(int32_t cmd, int32_t param) {
+    if (cmd < 0 || !mDevice || !mDevice->goodixExtCmd) {
+        return -ENOSYS;
+    }
+
+    auto start = steady_clock::now();
+    int ret = mDevice->goodixExtCmd(mDevice, cmd, param);
+    auto elapsed = steady_clock::now() - start;
+
+    mCalls++;
+    mTotalCallTime += elapsed;
+    mMaxCallTime = std::max(mMaxCallTime, elapsed);
+    if (ret != 0) {
+        mFailures++;
+        ALOGE("goodixExtCmd(%#x, %d) failed: %d", cmd, param, ret);
+    }
+
+    return ret;
+}
+
+void GoodixExtension::dump(std::ostream& stream) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    stream << "GoodixExtension:" << std::endl;
+    stream << "  Display state: " << ::android::internal::ToString(mState)
+           << ", screen: " << (mScreenOn ? "on" : "off")
+           << ", finger-fast: " << (mFfEnabled ? "armed" : "off") << std::endl;
+    stream << "  Commands: screen on " << mCommands.screenOn << ", screen off "
+           << mCommands.screenOff << ", finger-fast " << mCommands.ffFeature << std::endl;
+    stream << "  Transitions: " << mTransitions << ", calls: " << mCalls
+           << ", failed: " << mFailures << std::endl;
+    if (mCalls > 0) {
+        stream << "  Call latency avg: "
+               << duration_cast<microseconds>(mTotalCallTime / mCalls).count()
+               << " us, max: " << duration_cast<microseconds>(mMaxCallTime).count() << " us"
+               << std::endl;
+    }
+}
+
+}  // namespace aidl::android::hardware::biometrics::fingerprint
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/biometrics/common/DisplayState.h>
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+
+#include "fingerprint.h"
+
+namespace aidl::android::hardware::biometrics::fingerprint {
+
+// goodixExtCmd ids behind IGoodixBiometricsFingerprint screenOn/screenOff/enableFfFeature. They
+// differ between Goodix blobs, so each device configures its own. -1 leaves the hook alone.
+struct GoodixCommands {
+    int32_t screenOn = -1;
+    int32_t screenOff = -1;
+    int32_t ffFeature = -1;
+};
+
+// Drives the Goodix screenOn/screenOff and finger-fast (FF) hooks from the display state
+// the framework reports with each operation, so the sensor is armed before it is touched.
+class GoodixExtension {
+  public:
+    GoodixExtension(fingerprint_device_t* device, const GoodixCommands& commands);
+
+    void onDisplayStateChanged(common::DisplayState state);
+    // Runs a goodixExtCmd from the fingerprint extension. Screen and finger-fast commands go
+    // through the cached state so they are skipped when already in effect.
+    int handleExtCmd(int32_t cmd, int32_t param);
+    void dump(std::ostream& stream);
+
+  private:
+    int screenOn();
+    int screenOff();
+    int enableFfFeature(bool enable);
+    int extCmd(int32_t cmd, int32_t param);
+
+    fingerprint_device_t* mDevice;
+    const GoodixCommands mCommands;
+
+    std::mutex mLock;
+    common::DisplayState mState = common::DisplayState::UNKNOWN;
+    bool mScreenOn = true;
+    bool mFfEnabled = false;
+
+    uint64_t mTransitions = 0;
+    uint64_t mCalls = 0;
+    uint64_t mFailures = 0;
+    std::chrono::steady_clock::duration mTotalCallTime{};
+    std::chrono::steady_clock::duration mMaxCallTime{};
+};
+
+}  // namespace aidl::android::hardware::biometrics::fingerprint
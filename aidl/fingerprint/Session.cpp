@@ -21,13 +21,15 @@ void onClientDeath(void* cookie) {
     }
 }
 
-Session::Session(fingerprint_device_t* device, UdfpsHandler* udfpsHandler, int userId,
+Session::Session(fingerprint_device_t* device, UdfpsHandler* udfpsHandler,
+                 GoodixExtension* goodixExtension, int userId,
                  std::shared_ptr<ISessionCallback> cb, LockoutTracker lockoutTracker)
     : mDevice(device),
       mLockoutTracker(lockoutTracker),
       mUserId(userId),
       mCb(cb),
-      mUdfpsHandler(udfpsHandler) {
+      mUdfpsHandler(udfpsHandler),
+      mGoodixExtension(goodixExtension) {
     mDeathRecipient = AIBinder_DeathRecipient_new(onClientDeath);
 
     auto path = std::format("/data/vendor_de/{}/fpdata/", userId);
@@ -144,20 +146,23 @@ ndk::ScopedAStatus Session::onUiReady() {
 }
 
 ndk::ScopedAStatus Session::authenticateWithContext(
-        int64_t operationId, const common::OperationContext& /*context*/,
+        int64_t operationId, const common::OperationContext& context,
         std::shared_ptr<common::ICancellationSignal>* out) {
+    onDisplayStateChanged(context);
     return authenticate(operationId, out);
 }
 
 ndk::ScopedAStatus Session::enrollWithContext(const keymaster::HardwareAuthToken& hat,
-                                              const common::OperationContext& /*context*/,
+                                              const common::OperationContext& context,
                                               std::shared_ptr<common::ICancellationSignal>* out) {
+    onDisplayStateChanged(context);
     return enroll(hat, out);
 }
 
 ndk::ScopedAStatus Session::detectInteractionWithContext(
-        const common::OperationContext& /*context*/,
+        const common::OperationContext& context,
         std::shared_ptr<common::ICancellationSignal>* out) {
+    onDisplayStateChanged(context);
     return detectInteraction(out);
 }
 
@@ -169,7 +174,8 @@ ndk::ScopedAStatus Session::onPointerUpWithContext(const PointerContext& context
     return onPointerUp(context.pointerId);
 }
 
-ndk::ScopedAStatus Session::onContextChanged(const common::OperationContext& /*context*/) {
+ndk::ScopedAStatus Session::onContextChanged(const common::OperationContext& context) {
+    onDisplayStateChanged(context);
     return ndk::ScopedAStatus::ok();
 }
 
@@ -309,6 +315,12 @@ void Session::startLockoutTimer(int64_t timeout) {
     mIsLockoutTimerStarted = true;
 }
 
+void Session::onDisplayStateChanged(const OperationContext& context) {
+    if (mGoodixExtension) {
+        mGoodixExtension->onDisplayStateChanged(context.displayState);
+    }
+}
+
 void Session::lockoutTimerExpired() {
     if (!mIsLockoutTimerAborted) clearLockout(false);
 
@@ -14,6 +14,7 @@
 #include <log/log.h>
 #include "fingerprint.h"
 
+#include "GoodixExtension.h"
 #include "LockoutTracker.h"
 #include "UdfpsHandler.h"
 
@@ -28,8 +29,9 @@ void onClientDeath(void* cookie);
 
 class Session : public BnSession {
   public:
-    Session(fingerprint_device_t* device, UdfpsHandler* udfpsHandler, int userId,
-            std::shared_ptr<ISessionCallback> cb, LockoutTracker lockoutTracker);
+    Session(fingerprint_device_t* device, UdfpsHandler* udfpsHandler,
+            GoodixExtension* goodixExtension, int userId, std::shared_ptr<ISessionCallback> cb,
+            LockoutTracker lockoutTracker);
     ndk::ScopedAStatus generateChallenge() override;
     ndk::ScopedAStatus revokeChallenge(int64_t challenge) override;
     ndk::ScopedAStatus enroll(const HardwareAuthToken& hat,
@@ -95,6 +97,9 @@ class Session : public BnSession {
     AIBinder_DeathRecipient* mDeathRecipient;
 
     UdfpsHandler* mUdfpsHandler;
+    GoodixExtension* mGoodixExtension;
+
+    void onDisplayStateChanged(const OperationContext& context);
 };
 
 }  // namespace aidl::android::hardware::biometrics::fingerprint
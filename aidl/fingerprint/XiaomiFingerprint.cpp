@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "XiaomiFingerprint.h"
+
+#include <android-base/file.h>
+#include <chrono>
+#include <sstream>
+
+namespace aidl::vendor::xiaomi::hardware::fingerprintextension {
+
+using std::chrono::steady_clock;
+
+XiaomiFingerprint::XiaomiFingerprint(
+        std::shared_ptr<::aidl::android::hardware::biometrics::fingerprint::Fingerprint>
+                fingerprint)
+    : mFingerprint(std::move(fingerprint)) {}
+
+ndk::ScopedAStatus XiaomiFingerprint::extCmd(int32_t cmd, int32_t param1, int32_t* _aidl_return) {
+    Command command = {
+            .cmd = cmd,
+            .param = param1,
+            .posted = steady_clock::now(),
+    };
+
+    post(&command);
+    drain(&command);
+
+    {
+        std::unique_lock<std::mutex> lock(mDoneLock);
+        mDoneCv.wait(lock, [&command] { return command.done; });
+    }
+
+    *_aidl_return = command.result;
+    return ndk::ScopedAStatus::ok();
+}
+
+void XiaomiFingerprint::post(Command* command) {
+    Command* head = mHead.load(std::memory_order_relaxed);
+    do {
+        command->next = head;
+    } while (!mHead.compare_exchange_weak(head, command, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed));
+}
+
+/*
+ * The push in post() and the mHead check after a drainer lets go of mDraining are sequentially
+ * consistent, so either the poster wins mDraining or the drainer sees its command. Nobody is
+ * left waiting on a command that no thread will run.
+ */
+void XiaomiFingerprint::drain(const Command* own) {
+    while (mHead.load(std::memory_order_seq_cst) != nullptr) {
+        if (mDraining.exchange(true, std::memory_order_seq_cst)) {
+            // Another thread is draining and will run our command as part of its batch.
+            return;
+        }
+
+        // The mailbox is a stack, reverse it so commands run in the order they were posted.
+        Command* batch = nullptr;
+        for (Command* command = mHead.exchange(nullptr, std::memory_order_acquire);
+             command != nullptr;) {
+            Command* next = command->next;
+            command->next = batch;
+            batch = command;
+            command = next;
+        }
+
+        for (Command* command = batch; command != nullptr; command = command->next) {
+            command->result = mFingerprint->extCmd(command->cmd, command->param);
+            record(command->cmd, steady_clock::now() - command->posted);
+            if (command != own) {
+                mCombined.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        {
+            // A poster may return as soon as it sees done, so the batch must not be touched
+            // after the lock is dropped.
+            std::lock_guard<std::mutex> lock(mDoneLock);
+            for (Command* command = batch; command != nullptr; command = command->next) {
+                command->done = true;
+            }
+        }
+        mDoneCv.notify_all();
+
+        mDraining.store(false, std::memory_order_seq_cst);
+    }
+}
+
+void XiaomiFingerprint::record(int32_t cmd, steady_clock::duration latency) {
+    uint64_t latencyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+    size_t slot = (cmd >= 0 && static_cast<size_t>(cmd) < kStatsSlots - 1) ? cmd : kStatsSlots - 1;
+    CommandStats& stats = mStats[slot];
+
+    // Only the draining thread writes, so the max does not need a compare-exchange loop.
+    stats.count.fetch_add(1, std::memory_order_relaxed);
+    stats.totalNs.fetch_add(latencyNs, std::memory_order_relaxed);
+    stats.lastNs.store(latencyNs, std::memory_order_relaxed);
+    if (latencyNs > stats.maxNs.load(std::memory_order_relaxed)) {
+        stats.maxNs.store(latencyNs, std::memory_order_relaxed);
+    }
+
+    if (latencyNs > 16 * 1000 * 1000) {
+        ALOGW("extCmd(%d) took %llu us", cmd, static_cast<unsigned long long>(latencyNs / 1000));
+    }
+}
+
+binder_status_t XiaomiFingerprint::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    std::ostringstream stream;
+    stream << "XiaomiFingerprint:" << std::endl;
+    stream << "  Commands run on behalf of another caller: "
+           << mCombined.load(std::memory_order_relaxed) << std::endl;
+
+    for (size_t slot = 0; slot < kStatsSlots; slot++) {
+        const CommandStats& stats = mStats[slot];
+        uint64_t count = stats.count.load(std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+
+        if (slot == kStatsSlots - 1) {
+            stream << "  cmd other";
+        } else {
+            stream << "  cmd " << slot;
+        }
+        stream << ": count " << count << ", latency avg "
+               << stats.totalNs.load(std::memory_order_relaxed) / count << " ns, max "
+               << stats.maxNs.load(std::memory_order_relaxed) << " ns, last "
+               << stats.lastNs.load(std::memory_order_relaxed) << " ns" << std::endl;
+    }
+
+    ::android::base::WriteStringToFd(stream.str(), fd);
+    return STATUS_OK;
+}
+
+}  // namespace aidl::vendor::xiaomi::hardware::fingerprintextension
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/xiaomi/hardware/fingerprintextension/BnXiaomiFingerprint.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "Fingerprint.h"
+
+namespace aidl::vendor::xiaomi::hardware::fingerprintextension {
+
+class XiaomiFingerprint : public BnXiaomiFingerprint {
+  public:
+    XiaomiFingerprint(
+            std::shared_ptr<::aidl::android::hardware::biometrics::fingerprint::Fingerprint>
+                    fingerprint);
+
+    ndk::ScopedAStatus extCmd(int32_t cmd, int32_t param1, int32_t* _aidl_return) override;
+
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+  private:
+    // A command parked in the mailbox. It lives on the stack of the posting thread until
+    // the thread that drains the mailbox marks it done.
+    struct Command {
+        int32_t cmd;
+        int32_t param;
+        std::chrono::steady_clock::time_point posted;
+        int32_t result = 0;
+        Command* next = nullptr;
+        // Guarded by mDoneLock
+        bool done = false;
+    };
+
+    struct CommandStats {
+        std::atomic<uint64_t> count = 0;
+        std::atomic<uint64_t> totalNs = 0;
+        std::atomic<uint64_t> maxNs = 0;
+        std::atomic<uint64_t> lastNs = 0;
+    };
+
+    // Commands 0 .. kStatsSlots - 2 get their own slot, anything else shares the last one.
+    static constexpr size_t kStatsSlots = 16;
+
+    void post(Command* command);
+    void drain(const Command* own);
+    void record(int32_t cmd, std::chrono::steady_clock::duration latency);
+
+    std::shared_ptr<::aidl::android::hardware::biometrics::fingerprint::Fingerprint> mFingerprint;
+
+    // Lock-free mailbox: posters push onto mHead, whoever wins mDraining runs the batch
+    // in order on its own thread, so a command never takes an extra thread hop.
+    std::atomic<Command*> mHead = nullptr;
+    std::atomic<bool> mDraining = false;
+
+    // Posters whose command landed in another thread's batch sleep here until it ran
+    std::mutex mDoneLock;
+    std::condition_variable mDoneCv;
+
+    std::array<CommandStats, kStatsSlots> mStats;
+    std::atomic<uint64_t> mCombined = 0;
+};
+
+}  // namespace aidl::vendor::xiaomi::hardware::fingerprintextension
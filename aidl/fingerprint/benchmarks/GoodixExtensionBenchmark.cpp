@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <thread>
+
+#include "GoodixExtension.h"
+
+using aidl::android::hardware::biometrics::common::DisplayState;
+using aidl::android::hardware::biometrics::fingerprint::GoodixCommands;
+using aidl::android::hardware::biometrics::fingerprint::GoodixExtension;
+
+namespace {
+
+constexpr GoodixCommands kCommands = {
+        .screenOn = 0x200,
+        .screenOff = 0x201,
+        .ffFeature = 0x202,
+};
+
+/*
+ * Goodix module whose goodixExtCmd takes as long as the blob's, set per benchmark in us.
+ */
+struct FakeGoodixDevice {
+    fingerprint_device_t device = {};
+    std::chrono::microseconds callTime;
+
+    explicit FakeGoodixDevice(int64_t callTimeUs) : callTime(callTimeUs) {
+        device.goodixExtCmd = &FakeGoodixDevice::extCmd;
+    }
+
+    static int extCmd(fingerprint_device_t* dev, int32_t /* cmd */, int32_t /* param */) {
+        auto* self = reinterpret_cast<FakeGoodixDevice*>(dev);
+        std::this_thread::sleep_for(self->callTime);
+        return 0;
+    }
+};
+
+// Setting up each round sleeps through the blob's calls, keep the untimed part bounded
+constexpr int kRounds = 100;
+
+/*
+ * What a touch on the keyguard costs before the sensor can scan: the screen on and
+ * finger-fast commands the UDFPS handler sends with the press.
+ */
+void touch(benchmark::State& state, GoodixExtension* extension) {
+    auto start = std::chrono::steady_clock::now();
+    extension->handleExtCmd(kCommands.ffFeature, 1);
+    extension->handleExtCmd(kCommands.screenOn, 0);
+    state.SetIterationTime(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+// Nothing armed yet, as when the sensor is only set up once it is touched
+void BM_FirstTouchCold(benchmark::State& state) {
+    FakeGoodixDevice fake(state.range(0));
+
+    for (auto _ : state) {
+        GoodixExtension extension(&fake.device, kCommands);
+        extension.handleExtCmd(kCommands.screenOff, 0);
+        touch(state, &extension);
+    }
+}
+BENCHMARK(BM_FirstTouchCold)
+        ->Arg(0)
+        ->Arg(500)
+        ->Arg(2000)
+        ->Iterations(kRounds)
+        ->UseManualTime();
+
+// Armed from the LOCKSCREEN display state the operation started with
+void BM_FirstTouchPreArmed(benchmark::State& state) {
+    FakeGoodixDevice fake(state.range(0));
+
+    for (auto _ : state) {
+        GoodixExtension extension(&fake.device, kCommands);
+        extension.handleExtCmd(kCommands.screenOff, 0);
+        extension.onDisplayStateChanged(DisplayState::LOCKSCREEN);
+        touch(state, &extension);
+    }
+}
+BENCHMARK(BM_FirstTouchPreArmed)
+        ->Arg(0)
+        ->Arg(500)
+        ->Arg(2000)
+        ->Iterations(kRounds)
+        ->UseManualTime();
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
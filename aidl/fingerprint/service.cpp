@@ -6,6 +6,7 @@
 
 #include "Fingerprint.h"
 #include "FingerprintConfig.h"
+#include "XiaomiFingerprint.h"
 
 #include <android-base/logging.h>
 #include <android/binder_manager.h>
@@ -13,6 +14,7 @@
 
 using ::aidl::android::hardware::biometrics::fingerprint::Fingerprint;
 using ::aidl::android::hardware::biometrics::fingerprint::FingerprintConfig;
+using ::aidl::vendor::xiaomi::hardware::fingerprintextension::XiaomiFingerprint;
 
 int main() {
     ABinderProcess_setThreadPoolMaxThreadCount(0);
@@ -27,6 +29,13 @@ int main() {
             AServiceManager_addService(fingerprint->asBinder().get(), instance.c_str());
     CHECK(status == STATUS_OK);
 
+    std::shared_ptr<XiaomiFingerprint> xiaomiFingerprint =
+            ndk::SharedRefBase::make<XiaomiFingerprint>(fingerprint);
+
+    const std::string extInstance = std::string() + XiaomiFingerprint::descriptor + "/default";
+    status = AServiceManager_addService(xiaomiFingerprint->asBinder().get(), extInstance.c_str());
+    CHECK(status == STATUS_OK);
+
     ABinderProcess_joinThreadPool();
     return EXIT_FAILURE;  // should not reach
 }
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "GoodixExtension.h"
+
+using aidl::android::hardware::biometrics::common::DisplayState;
+using aidl::android::hardware::biometrics::fingerprint::GoodixCommands;
+using aidl::android::hardware::biometrics::fingerprint::GoodixExtension;
+
+namespace {
+
+constexpr GoodixCommands kCommands = {
+        .screenOn = 0x200,
+        .screenOff = 0x201,
+        .ffFeature = 0x202,
+};
+
+/*
+ * Goodix module that only implements goodixExtCmd, recording every call it gets.
+ */
+struct FakeGoodixDevice {
+    fingerprint_device_t device = {};
+    std::vector<std::pair<int32_t, int32_t>> calls;
+    int failuresLeft = 0;
+
+    FakeGoodixDevice() { device.goodixExtCmd = &FakeGoodixDevice::extCmd; }
+
+    static int extCmd(fingerprint_device_t* dev, int32_t cmd, int32_t param) {
+        auto* self = reinterpret_cast<FakeGoodixDevice*>(dev);
+        self->calls.emplace_back(cmd, param);
+        if (self->failuresLeft > 0) {
+            self->failuresLeft--;
+            return -EIO;
+        }
+        return 0;
+    }
+
+    std::vector<std::pair<int32_t, int32_t>> takeCalls() { return std::exchange(calls, {}); }
+};
+
+using Calls = std::vector<std::pair<int32_t, int32_t>>;
+
+}  // anonymous namespace
+
+TEST(GoodixExtensionTest, ArmsFingerFastOnKeyguard) {
+    FakeGoodixDevice fake;
+    GoodixExtension extension(&fake.device, kCommands);
+
+    extension.onDisplayStateChanged(DisplayState::LOCKSCREEN);
+    EXPECT_EQ(fake.takeCalls(), Calls({{kCommands.ffFeature, 1}}));
+}
+
+TEST(GoodixExtensionTest, ArmsFingerFastBeforeTheScreenGoesOff) {
+    FakeGoodixDevice fake;
+    GoodixExtension extension(&fake.device, kCommands);
+
+    extension.onDisplayStateChanged(DisplayState::NO_UI);
+    EXPECT_EQ(fake.takeCalls(), Calls());
+
+    // No window where neither screen on nor finger-fast is active
+    extension.onDisplayStateChanged(DisplayState::AOD);
+    EXPECT_EQ(fake.takeCalls(), Calls({{kCommands.ffFeature, 1}, {kCommands.screenOff, 0}}));
+
+    extension.onDisplayStateChanged(DisplayState::NO_UI);
+    EXPECT_EQ(fake.takeCalls(), Calls({{kCommands.screenOn, 0}, {kCommands.ffFeature, 0}}));
+}
+
+TEST(GoodixExtensionTest, RepeatedAndUnknownStatesSendNothing) {
+    FakeGoodixDevice fake;
+    GoodixExtension extension(&fake.device, kCommands);
+
+    extension.onDisplayStateChanged(DisplayState::AOD);
+    fake.takeCalls();
+
+    extension.onDisplayStateChanged(DisplayState::AOD);
+    extension.onDisplayStateChanged(DisplayState::UNKNOWN);
+    extension.onDisplayStateChanged(DisplayState::SCREENSAVER);
+    EXPECT_EQ(fake.takeCalls(), Calls());
+}
+
+TEST(GoodixExtensionTest, RetriesAFailedCallOnTheNextTransition) {
+    FakeGoodixDevice fake;
+    GoodixExtension extension(&fake.device, kCommands);
+
+    fake.failuresLeft = 1;
+    extension.onDisplayStateChanged(DisplayState::LOCKSCREEN);
+    EXPECT_EQ(fake.takeCalls(), Calls({{kCommands.ffFeature, 1}}));
+
+    extension.onDisplayStateChanged(DisplayState::SCREENSAVER);
+    EXPECT_EQ(fake.takeCalls(), Calls({{kCommands.ffFeature, 1}, {kCommands.screenOff, 0}}));
+}
+
+TEST(GoodixExtensionTest, UnconfiguredCommandsAreNotSent) {
+    FakeGoodixDevice fake;
+    GoodixExtension extension(&fake.device, {.ffFeature = kCommands.ffFeature});
+
+    extension.onDisplayStateChanged(DisplayState::AOD);
+    EXPECT_EQ(fake.takeCalls(), Calls({{kCommands.ffFeature, 1}}));
+
+    extension.onDisplayStateChanged(DisplayState::NO_UI);
+    EXPECT_EQ(fake.takeCalls(), Calls({{kCommands.ffFeature, 0}}));
+}
+
+TEST(GoodixExtensionTest, ModulesWithoutTheHookAreLeftAlone) {
+    fingerprint_device_t device = {};
+    GoodixExtension extension(&device, kCommands);
+
+    extension.onDisplayStateChanged(DisplayState::AOD);
+    std::ostringstream dump;
+    extension.dump(dump);
+    EXPECT_NE(dump.str().find("calls: 0"), std::string::npos);
+}
+
+TEST(GoodixExtensionTest, ExtCmdsShareTheCachedState) {
+    FakeGoodixDevice fake;
+    GoodixExtension extension(&fake.device, kCommands);
+
+    extension.onDisplayStateChanged(DisplayState::AOD);
+    fake.takeCalls();
+
+    // Already off and armed from the display state, nothing left to send
+    EXPECT_EQ(extension.handleExtCmd(kCommands.screenOff, 0), 0);
+    EXPECT_EQ(extension.handleExtCmd(kCommands.ffFeature, 1), 0);
+    EXPECT_EQ(fake.takeCalls(), Calls());
+
+    EXPECT_EQ(extension.handleExtCmd(kCommands.screenOn, 0), 0);
+    EXPECT_EQ(extension.handleExtCmd(kCommands.ffFeature, 0), 0);
+    EXPECT_EQ(fake.takeCalls(), Calls({{kCommands.screenOn, 0}, {kCommands.ffFeature, 0}}));
+
+    // And the display state picks up from what the commands left
+    extension.onDisplayStateChanged(DisplayState::NO_UI);
+    EXPECT_EQ(fake.takeCalls(), Calls());
+}
+
+TEST(GoodixExtensionTest, OtherExtCmdsArePassedThrough) {
+    FakeGoodixDevice fake;
+    GoodixExtension extension(&fake.device, kCommands);
+
+    EXPECT_EQ(extension.handleExtCmd(0x300, 5), 0);
+    EXPECT_EQ(extension.handleExtCmd(0x300, 5), 0);
+    EXPECT_EQ(fake.takeCalls(), Calls({{0x300, 5}, {0x300, 5}}));
+
+    fake.failuresLeft = 1;
+    EXPECT_EQ(extension.handleExtCmd(0x300, 6), -EIO);
+}
@@ -7,12 +7,23 @@
 
 #include "ConsumerIr.h"
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <fcntl.h>
 #include <linux/lirc.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <algorithm>
+#include <sstream>
 #include <string>
 
 using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
 
 namespace aidl {
 namespace android {
@@ -21,59 +32,511 @@ namespace ir {
 
 static const std::string kIrDevice = "/dev/lirc0";
 
+// Past this many queued, transmit waits for room and repeats are rejected
+static constexpr size_t kMaxQueuedTransmits = 16;
+static constexpr size_t kMaxRegisteredPatterns = 32;
+
+// Limits enforced by lirc_transmit_ir, checked up front so that bad patterns never reach it
+static constexpr size_t kMaxWriteEntries = 1024;
+static constexpr int64_t kMaxDurationUs = 500000;
+
 static vector<ConsumerIrFreqRange> kRangeVec{
         {.minHz = 30000, .maxHz = 60000},
 };
 
-::ndk::ScopedAStatus ConsumerIr::getCarrierFreqs(vector<ConsumerIrFreqRange>* _aidl_return) {
-    *_aidl_return = kRangeVec;
+ConsumerIr::ConsumerIr() : mCarrierRanges(kRangeVec) {
+    if (openDevice()) {
+        queryFeatures();
+    }
 
-    return ::ndk::ScopedAStatus::ok();
+    mTimerFd.reset(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+    if (!mTimerFd.ok()) {
+        PLOG(ERROR) << "Failed to create timerfd";
+    }
+
+    mWakeFd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (!mWakeFd.ok()) {
+        PLOG(ERROR) << "Failed to create eventfd";
+    }
+
+    mWorker = std::thread(&ConsumerIr::workerThread, this);
 }
 
-::ndk::ScopedAStatus ConsumerIr::transmit(int32_t carrierFreqHz, const vector<int32_t>& pattern) {
-    size_t entries = pattern.size();
+ConsumerIr::~ConsumerIr() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCv.notify_all();
+    mSpaceCv.notify_all();
+    eventfd_write(mWakeFd.get(), 1);
+    mWorker.join();
+
+    // Don't leave transmit callers waiting on requests that will never run
+    for (TransmitRequest& request : mQueue) {
+        if (request.result) {
+            request.result->set_value(EX_ILLEGAL_STATE);
+        }
+    }
+}
+
+bool ConsumerIr::openDevice() {
+    mFd.reset(TEMP_FAILURE_RETRY(open(kIrDevice.c_str(), O_RDWR | O_CLOEXEC)));
+    if (!mFd.ok()) {
+        PLOG(ERROR) << "Failed to open " << kIrDevice;
+        return false;
+    }
+
+    // The driver carrier is unknown after (re)opening
+    mCarrierFreqHz = 0;
+
+    uint32_t mode;
+    if (ioctl(mFd.get(), LIRC_GET_SEND_MODE, &mode) == 0 && mode != LIRC_MODE_PULSE) {
+        mode = LIRC_MODE_PULSE;
+        if (ioctl(mFd.get(), LIRC_SET_SEND_MODE, &mode) < 0) {
+            PLOG(ERROR) << "Failed to switch " << kIrDevice << " to pulse mode";
+        }
+    }
+
+    return true;
+}
+
+void ConsumerIr::queryFeatures() {
+    uint32_t features;
+    if (ioctl(mFd.get(), LIRC_GET_FEATURES, &features) < 0) {
+        PLOG(WARNING) << "Failed to get features of " << kIrDevice << ", assuming defaults";
+        return;
+    }
+
+    mCanSend = (features & LIRC_CAN_SEND_PULSE) != 0;
+    mCanSetCarrier = (features & LIRC_CAN_SET_SEND_CARRIER) != 0;
+    mCanSetDutyCycle = (features & LIRC_CAN_SET_SEND_DUTY_CYCLE) != 0;
+
+    if (mCanSend) {
+        mCarrierRanges = kRangeVec;
+    } else {
+        LOG(ERROR) << kIrDevice << " cannot send pulses, features: 0x" << std::hex << features;
+        mCarrierRanges.clear();
+    }
+
+    LOG(INFO) << kIrDevice << " features: send " << mCanSend << ", set carrier "
+              << mCanSetCarrier << ", set duty cycle " << mCanSetDutyCycle;
+}
+
+/*
+ * Check a pattern against the cached capabilities and normalize it in one pass, so that the
+ * driver only ever sees patterns it accepts: zero-length entries are merged away since the
+ * driver rejects them, and entries longer than the driver maximum are clamped.
+ */
+::ndk::ScopedAStatus ConsumerIr::normalizePattern(int32_t carrierFreqHz,
+                                                  const vector<int32_t>& pattern,
+                                                  vector<int32_t>* out) const {
+    if (!mCanSend) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+
+    if (mCanSetCarrier &&
+        std::none_of(mCarrierRanges.begin(), mCarrierRanges.end(), [&](const auto& range) {
+            return carrierFreqHz >= range.minHz && carrierFreqHz <= range.maxHz;
+        })) {
+        LOG(ERROR) << "Unsupported carrier " << carrierFreqHz;
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+
+    out->clear();
+    out->reserve(pattern.size());
+
+    // A zero-length entry joins its neighbours, which have the same polarity
+    bool merge = false;
+    for (int32_t entry : pattern) {
+        if (entry < 0) {
+            LOG(ERROR) << "Negative entry " << entry << " in pattern";
+            return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+        }
 
-    if (entries == 0) {
+        if (entry == 0) {
+            merge = !merge;
+            continue;
+        }
+
+        entry = static_cast<int32_t>(std::min<int64_t>(entry, kMaxDurationUs));
+        if (merge && !out->empty()) {
+            int64_t merged = static_cast<int64_t>(out->back()) + entry;
+            out->back() = static_cast<int32_t>(std::min(merged, kMaxDurationUs));
+        } else if (!merge) {
+            out->push_back(entry);
+        }
+        // Otherwise this is a gap before the first pulse, which is dropped
+        merge = false;
+    }
+
+    // Nothing but gaps, which callers treat as nothing to send
+    if (out->empty()) {
         return ::ndk::ScopedAStatus::ok();
     }
 
-    int fd = open(kIrDevice.c_str(), O_RDWR);
-    if (fd < 0) {
-        LOG(ERROR) << "Failed to open " << kIrDevice << ", error " << fd;
+    // Everything but a trailing gap is written to the driver
+    size_t toWrite = (out->size() & 1) != 0 ? out->size() : out->size() - 1;
+    int64_t duration = 0;
+    for (size_t i = 0; i < toWrite; i++) {
+        duration += (*out)[i];
+    }
 
-        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    if (toWrite > kMaxWriteEntries || duration > kMaxDurationUs) {
+        LOG(ERROR) << "Pattern too long, " << toWrite << " entries, " << duration << " us";
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+bool ConsumerIr::setCarrier(int32_t carrierFreqHz) {
+    // Drivers with a fixed carrier reject the ioctl
+    if (!mCanSetCarrier || carrierFreqHz == mCarrierFreqHz) {
+        return true;
     }
 
-    int rc = ioctl(fd, LIRC_SET_SEND_CARRIER, &carrierFreqHz);
+    int rc = ioctl(mFd.get(), LIRC_SET_SEND_CARRIER, &carrierFreqHz);
     if (rc < 0) {
         LOG(ERROR) << "Failed to set carrier " << carrierFreqHz << ", error: " << errno;
+        mCarrierFreqHz = 0;
+        return false;
+    }
 
-        close(fd);
+    mCarrierFreqHz = carrierFreqHz;
+    return true;
+}
 
-        return ::ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+::ndk::ScopedAStatus ConsumerIr::getCarrierFreqs(vector<ConsumerIrFreqRange>* _aidl_return) {
+    *_aidl_return = mCarrierRanges;
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+/*
+ * Returns once the pattern has been written or has failed, as IConsumerIr requires. Only its
+ * trailing gap is left to the worker, which holds back the next pattern until it has passed.
+ */
+::ndk::ScopedAStatus ConsumerIr::transmit(int32_t carrierFreqHz, const vector<int32_t>& pattern) {
+    vector<int32_t> entries;
+    ::ndk::ScopedAStatus status = normalizePattern(carrierFreqHz, pattern, &entries);
+    if (!status.isOk() || entries.empty()) {
+        return status;
     }
 
-    if ((entries & 1) != 0) {
-        rc = write(fd, pattern.data(), entries * sizeof(int32_t));
-    } else {
-        rc = write(fd, pattern.data(), (entries - 1) * sizeof(int32_t));
-        usleep(pattern[entries - 1]);
+    auto result = std::make_shared<std::promise<binder_exception_t>>();
+    std::future<binder_exception_t> future = result->get_future();
+
+    status = enqueue({std::make_shared<const Pattern>(carrierFreqHz, std::move(entries)),
+                      1 /* repeatCount */, microseconds(0), steady_clock::now(),
+                      false /* cancelable */, result},
+                     true /* waitForSpace */);
+    if (!status.isOk()) {
+        return status;
     }
 
-    if (rc < 0) {
-        LOG(ERROR) << "Failed to write pattern, " << entries << " entries, error: " << errno;
+    binder_exception_t exception = future.get();
+    if (exception != EX_NONE) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(exception);
+    }
 
-        close(fd);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus ConsumerIr::registerPattern(int32_t carrierFreqHz,
+                                                 const vector<int32_t>& pattern,
+                                                 int32_t* handle) {
+    vector<int32_t> entries;
+    ::ndk::ScopedAStatus status = normalizePattern(carrierFreqHz, pattern, &entries);
+    if (!status.isOk()) {
+        return status;
+    } else if (entries.empty()) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
 
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mPatterns.size() >= kMaxRegisteredPatterns) {
+        LOG(ERROR) << "Too many registered patterns";
         return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
 
-    close(fd);
+    *handle = mNextHandle++;
+    mPatterns[*handle] = std::make_shared<const Pattern>(carrierFreqHz, std::move(entries));
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus ConsumerIr::unregisterPattern(int32_t handle) {
+    std::lock_guard<std::mutex> lock(mLock);
+    // Queued repeats keep their own reference, so they still complete
+    if (mPatterns.erase(handle) == 0) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus ConsumerIr::transmitRepeat(int32_t handle, int32_t repeatCount,
+                                                int32_t intervalUs) {
+    if (repeatCount <= 0 || intervalUs < 0) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    std::shared_ptr<const Pattern> pattern;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mPatterns.find(handle);
+        if (it == mPatterns.end()) {
+            return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+        }
+        pattern = it->second;
+    }
+
+    return enqueue({std::move(pattern), repeatCount, microseconds(intervalUs), steady_clock::now(),
+                    true /* cancelable */},
+                   false /* waitForSpace */);
+}
+
+::ndk::ScopedAStatus ConsumerIr::cancelRepeat() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mCancelGeneration++;
+
+        size_t queued = mQueue.size();
+        std::erase_if(mQueue, [](const TransmitRequest& request) { return request.cancelable; });
+        mCanceled += queued - mQueue.size();
+    }
+    eventfd_write(mWakeFd.get(), 1);
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus ConsumerIr::enqueue(TransmitRequest request, bool waitForSpace) {
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        if (waitForSpace) {
+            mSpaceCv.wait(lock, [this] { return mExit || mQueue.size() < kMaxQueuedTransmits; });
+            if (mExit) {
+                return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+            }
+        } else if (mQueue.size() >= kMaxQueuedTransmits) {
+            LOG(ERROR) << "Transmit queue full, dropping pattern of "
+                       << request.pattern->entries.size() << " entries";
+            mRejected++;
+
+            return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+        }
+
+        request.cancelGeneration = mCancelGeneration;
+        mQueue.push_back(std::move(request));
+    }
+    mCv.notify_one();
 
     return ::ndk::ScopedAStatus::ok();
 }
 
+void ConsumerIr::workerThread() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (true) {
+        mCv.wait(lock, [this] { return mExit || !mQueue.empty(); });
+        if (mExit) {
+            break;
+        }
+
+        TransmitRequest request = std::move(mQueue.front());
+        mQueue.pop_front();
+        mSpaceCv.notify_one();
+
+        lock.unlock();
+        transmitRequest(request);
+        lock.lock();
+    }
+}
+
+/*
+ * Sleep on the timerfd until deadline. Returns false if the wait was cut short because the
+ * request was canceled or the service is exiting.
+ */
+bool ConsumerIr::waitUntil(steady_clock::time_point deadline, const TransmitRequest& request) {
+    auto interrupted = [&] {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mExit || (request.cancelable && request.cancelGeneration != mCancelGeneration);
+    };
+
+    if (deadline <= steady_clock::now()) {
+        return !interrupted();
+    }
+
+    auto sinceEpoch = duration_cast<nanoseconds>(deadline.time_since_epoch());
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = duration_cast<seconds>(sinceEpoch).count();
+    spec.it_value.tv_nsec = (sinceEpoch % seconds(1)).count();
+
+    if (timerfd_settime(mTimerFd.get(), TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+        PLOG(ERROR) << "Failed to arm timerfd, falling back to sleep";
+        std::this_thread::sleep_until(deadline);
+        return !interrupted();
+    }
+
+    while (true) {
+        struct pollfd fds[] = {
+                {.fd = mTimerFd.get(), .events = POLLIN},
+                {.fd = mWakeFd.get(), .events = POLLIN},
+        };
+        if (TEMP_FAILURE_RETRY(poll(fds, 2, -1)) < 0) {
+            PLOG(ERROR) << "Failed to poll timerfd";
+            return !interrupted();
+        }
+
+        if (fds[1].revents & POLLIN) {
+            eventfd_t value;
+            eventfd_read(mWakeFd.get(), &value);
+            if (interrupted()) {
+                return false;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(mTimerFd.get(), &expirations, sizeof(expirations)) < 0) {
+                PLOG(WARNING) << "Failed to read timerfd";
+            }
+            return true;
+        }
+    }
+}
+
+// Returns the exception transmit reports for the write, EX_NONE on success
+binder_exception_t ConsumerIr::writePattern(const Pattern& pattern) {
+    const vector<int32_t>& entries = pattern.entries;
+
+    if (!mFd.ok() && !openDevice()) {
+        return EX_ILLEGAL_STATE;
+    }
+
+    if (!setCarrier(pattern.carrierFreqHz)) {
+        return EX_UNSUPPORTED_OPERATION;
+    }
+
+    // The driver wants an odd number of entries ending with a pulse
+    size_t toWrite = (entries.size() & 1) != 0 ? entries.size() : entries.size() - 1;
+    int rc = write(mFd.get(), entries.data(), toWrite * sizeof(int32_t));
+    if (rc < 0) {
+        LOG(ERROR) << "Failed to write pattern, " << entries.size() << " entries, error: " << errno;
+        // Reopen on the next transmit in case the device went away
+        mFd.reset();
+        return EX_ILLEGAL_STATE;
+    }
+
+    return EX_NONE;
+}
+
+void ConsumerIr::transmitRequest(const TransmitRequest& request) {
+    const vector<int32_t>& entries = request.pattern->entries;
+    steady_clock::time_point scheduled;
+
+    for (int32_t repeat = 0; repeat < request.repeatCount; repeat++) {
+        // Honour the trailing gap of the previous pattern without blocking any binder thread
+        steady_clock::time_point deadline = mNextTransmitTime;
+        if (repeat > 0) {
+            scheduled += request.interval;
+            deadline = std::max(deadline, scheduled);
+        }
+
+        if (!waitUntil(deadline, request)) {
+            if (request.result && repeat == 0) {
+                request.result->set_value(EX_ILLEGAL_STATE);
+            }
+
+            std::lock_guard<std::mutex> lock(mLock);
+            if (request.cancelable) {
+                mCanceled++;
+            }
+            return;
+        }
+
+        steady_clock::time_point start = steady_clock::now();
+        if (repeat == 0) {
+            scheduled = start;
+        }
+
+        binder_exception_t exception = writePattern(*request.pattern);
+
+        steady_clock::time_point now = steady_clock::now();
+        if (exception == EX_NONE && (entries.size() & 1) == 0) {
+            mNextTransmitTime = now + microseconds(entries.back());
+        }
+
+        // The caller only waits for the write, not for the trailing gap
+        if (request.result && repeat == 0) {
+            request.result->set_value(exception);
+        }
+
+        std::lock_guard<std::mutex> lock(mLock);
+        if (exception != EX_NONE) {
+            mFailed++;
+            return;
+        }
+
+        if (repeat == 0) {
+            nanoseconds latency = now - request.enqueueTime;
+            mTotalLatency += latency;
+            mMaxLatency = std::max(mMaxLatency, latency);
+        } else {
+            nanoseconds jitter = start > scheduled ? start - scheduled : scheduled - start;
+            mRepeats++;
+            mTotalRepeatJitter += jitter;
+            mMaxRepeatJitter = std::max(mMaxRepeatJitter, jitter);
+        }
+
+        if (mTransmitted == 0) {
+            mFirstTransmitTime = now;
+        }
+        mTransmitted++;
+        mEntriesWritten += entries.size();
+        mLastTransmitTime = now;
+    }
+}
+
+binder_status_t ConsumerIr::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    std::ostringstream stream;
+    stream << "ConsumerIr:" << std::endl;
+    stream << "  Can send: " << mCanSend << ", set carrier: " << mCanSetCarrier
+           << ", set duty cycle: " << mCanSetDutyCycle << std::endl;
+    stream << "  Queued: " << mQueue.size() << "/" << kMaxQueuedTransmits << std::endl;
+    stream << "  Registered patterns: " << mPatterns.size() << "/" << kMaxRegisteredPatterns
+           << std::endl;
+    stream << "  Transmitted: " << mTransmitted << ", failed: " << mFailed
+           << ", rejected: " << mRejected << ", canceled: " << mCanceled << std::endl;
+
+    if (mTransmitted > mRepeats) {
+        stream << "  Latency avg: "
+               << duration_cast<microseconds>(mTotalLatency / (mTransmitted - mRepeats)).count()
+               << " us, max: " << duration_cast<microseconds>(mMaxLatency).count() << " us"
+               << std::endl;
+    }
+
+    if (mRepeats > 0) {
+        stream << "  Repeat jitter avg: "
+               << duration_cast<microseconds>(mTotalRepeatJitter / mRepeats).count()
+               << " us, max: " << duration_cast<microseconds>(mMaxRepeatJitter).count() << " us"
+               << std::endl;
+    }
+
+    auto elapsed = duration_cast<microseconds>(mLastTransmitTime - mFirstTransmitTime);
+    if (mTransmitted > 1 && elapsed.count() > 0) {
+        stream << "  Throughput: " << (mTransmitted - 1) * 1000000.0 / elapsed.count()
+               << " patterns/s, " << mEntriesWritten * 1000000.0 / elapsed.count()
+               << " entries/s" << std::endl;
+    }
+
+    ::android::base::WriteStringToFd(stream.str(), fd);
+    return STATUS_OK;
+}
+
 }  // namespace ir
 }  // namespace hardware
 }  // namespace android
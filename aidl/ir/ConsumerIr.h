@@ -6,6 +6,16 @@
 #pragma once
 
 #include <aidl/android/hardware/ir/BnConsumerIr.h>
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace aidl {
 namespace android {
@@ -14,11 +24,97 @@ namespace ir {
 
 class ConsumerIr : public BnConsumerIr {
   public:
+    ConsumerIr();
+    ~ConsumerIr();
+
     ::ndk::ScopedAStatus getCarrierFreqs(
             ::std::vector<::aidl::android::hardware::ir::ConsumerIrFreqRange>* _aidl_return)
             override;
     ::ndk::ScopedAStatus transmit(int32_t carrierFreqHz,
                                   const ::std::vector<int32_t>& pattern) override;
+
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+    // Backing for vendor.xiaomi.hardware.ir.IConsumerIrExt
+    ::ndk::ScopedAStatus registerPattern(int32_t carrierFreqHz,
+                                         const ::std::vector<int32_t>& pattern, int32_t* handle);
+    ::ndk::ScopedAStatus unregisterPattern(int32_t handle);
+    ::ndk::ScopedAStatus transmitRepeat(int32_t handle, int32_t repeatCount, int32_t intervalUs);
+    ::ndk::ScopedAStatus cancelRepeat();
+
+  private:
+    struct Pattern {
+        Pattern(int32_t carrierFreqHz, std::vector<int32_t> entries)
+            : carrierFreqHz(carrierFreqHz), entries(std::move(entries)) {}
+
+        const int32_t carrierFreqHz;
+        const std::vector<int32_t> entries;
+    };
+
+    struct TransmitRequest {
+        std::shared_ptr<const Pattern> pattern;
+        int32_t repeatCount;
+        std::chrono::microseconds interval;
+        std::chrono::steady_clock::time_point enqueueTime;
+        // Only repeats can be canceled, and only by cancelRepeat calls made after enqueueing
+        bool cancelable;
+        // Set once the first write is done, for callers that wait for it
+        std::shared_ptr<std::promise<binder_exception_t>> result;
+        uint64_t cancelGeneration = 0;
+    };
+
+    void queryFeatures();
+    ::ndk::ScopedAStatus normalizePattern(int32_t carrierFreqHz,
+                                          const ::std::vector<int32_t>& pattern,
+                                          ::std::vector<int32_t>* out) const;
+    ::ndk::ScopedAStatus enqueue(TransmitRequest request, bool waitForSpace);
+    void workerThread();
+    bool openDevice();
+    bool setCarrier(int32_t carrierFreqHz);
+    bool waitUntil(std::chrono::steady_clock::time_point deadline, const TransmitRequest& request);
+    binder_exception_t writePattern(const Pattern& pattern);
+    void transmitRequest(const TransmitRequest& request);
+
+    // Driver capabilities, queried once at startup. Defaults apply if the driver can't say.
+    bool mCanSend = true;
+    bool mCanSetCarrier = true;
+    bool mCanSetDutyCycle = false;
+    std::vector<ConsumerIrFreqRange> mCarrierRanges;
+
+    // Only touched by the worker thread
+    ::android::base::unique_fd mFd;
+    int32_t mCarrierFreqHz = 0;
+    std::chrono::steady_clock::time_point mNextTransmitTime;
+    ::android::base::unique_fd mTimerFd;
+
+    // Written to wake the worker out of waitUntil() on cancel or exit
+    ::android::base::unique_fd mWakeFd;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    // Signalled when the worker takes a request, for transmit calls waiting on a full queue
+    std::condition_variable mSpaceCv;
+    std::deque<TransmitRequest> mQueue;
+    std::unordered_map<int32_t, std::shared_ptr<const Pattern>> mPatterns;
+    int32_t mNextHandle = 1;
+    uint64_t mCancelGeneration = 0;
+    bool mExit = false;
+
+    // Statistics, guarded by mLock
+    uint64_t mTransmitted = 0;
+    uint64_t mFailed = 0;
+    uint64_t mRejected = 0;
+    uint64_t mCanceled = 0;
+    uint64_t mEntriesWritten = 0;
+    std::chrono::nanoseconds mTotalLatency{0};
+    std::chrono::nanoseconds mMaxLatency{0};
+    std::chrono::steady_clock::time_point mFirstTransmitTime;
+    std::chrono::steady_clock::time_point mLastTransmitTime;
+    uint64_t mRepeats = 0;
+    std::chrono::nanoseconds mTotalRepeatJitter{0};
+    std::chrono::nanoseconds mMaxRepeatJitter{0};
+
+    std::thread mWorker;
 };
 
 }  // namespace ir
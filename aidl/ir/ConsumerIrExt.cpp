@@ -0,0 +1,40 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ConsumerIrExt.h"
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace ir {
+
+ConsumerIrExt::ConsumerIrExt(std::shared_ptr<::aidl::android::hardware::ir::ConsumerIr> consumerIr)
+    : mConsumerIr(std::move(consumerIr)) {}
+
+::ndk::ScopedAStatus ConsumerIrExt::registerPattern(int32_t carrierFreqHz,
+                                                    const std::vector<int32_t>& pattern,
+                                                    int32_t* _aidl_return) {
+    return mConsumerIr->registerPattern(carrierFreqHz, pattern, _aidl_return);
+}
+
+::ndk::ScopedAStatus ConsumerIrExt::unregisterPattern(int32_t handle) {
+    return mConsumerIr->unregisterPattern(handle);
+}
+
+::ndk::ScopedAStatus ConsumerIrExt::transmitRepeat(int32_t handle, int32_t repeatCount,
+                                                   int32_t intervalUs) {
+    return mConsumerIr->transmitRepeat(handle, repeatCount, intervalUs);
+}
+
+::ndk::ScopedAStatus ConsumerIrExt::cancelRepeat() {
+    return mConsumerIr->cancelRepeat();
+}
+
+}  // namespace ir
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
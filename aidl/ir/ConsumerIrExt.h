@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/xiaomi/hardware/ir/BnConsumerIrExt.h>
+
+#include "ConsumerIr.h"
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace ir {
+
+class ConsumerIrExt : public BnConsumerIrExt {
+  public:
+    ConsumerIrExt(std::shared_ptr<::aidl::android::hardware::ir::ConsumerIr> consumerIr);
+
+    ::ndk::ScopedAStatus registerPattern(int32_t carrierFreqHz,
+                                         const ::std::vector<int32_t>& pattern,
+                                         int32_t* _aidl_return) override;
+    ::ndk::ScopedAStatus unregisterPattern(int32_t handle) override;
+    ::ndk::ScopedAStatus transmitRepeat(int32_t handle, int32_t repeatCount,
+                                        int32_t intervalUs) override;
+    ::ndk::ScopedAStatus cancelRepeat() override;
+
+  private:
+    std::shared_ptr<::aidl::android::hardware::ir::ConsumerIr> mConsumerIr;
+};
+
+}  // namespace ir
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
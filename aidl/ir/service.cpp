@@ -4,19 +4,25 @@
  */
 
 #include "ConsumerIr.h"
+#include "ConsumerIrExt.h"
 
 #include <android-base/logging.h>
 #include <android/binder_manager.h>
 #include <android/binder_process.h>
 
 using aidl::android::hardware::ir::ConsumerIr;
+using aidl::vendor::xiaomi::hardware::ir::ConsumerIrExt;
 
 int main() {
     ABinderProcess_setThreadPoolMaxThreadCount(0);
     std::shared_ptr<ConsumerIr> hal = ::ndk::SharedRefBase::make<ConsumerIr>();
+    std::shared_ptr<ConsumerIrExt> ext = ::ndk::SharedRefBase::make<ConsumerIrExt>(hal);
+
+    binder_status_t status = AIBinder_setExtension(hal->asBinder().get(), ext->asBinder().get());
+    CHECK_EQ(status, STATUS_OK);
 
     const std::string instance = std::string(ConsumerIr::descriptor) + "/default";
-    binder_status_t status = AServiceManager_addService(hal->asBinder().get(), instance.c_str());
+    status = AServiceManager_addService(hal->asBinder().get(), instance.c_str());
     CHECK_EQ(status, STATUS_OK);
 
     ABinderProcess_joinThreadPool();
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <array>
+#include <optional>
+#include <utility>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/**
+ * Hands each direct channel memory type to the first subhal with a sensor supporting it. The
+ * proxy only advertises a memory type on sensors of its owner and registers channels of that
+ * type with the owner alone, so each channel has one writer and every sensor the framework may
+ * configure on it belongs to that writer.
+ *
+ * This is not multiplexing. Sensors of other subhals lose direct report for that memory type
+ * rather than sharing a channel, because SharedMemInfo has no offset to give each subhal its
+ * own region of the buffer. With a single subhal it behaves exactly like upstream.
+ */
+class DirectChannelOwners {
+  public:
+    using SensorFlagBits = ::android::hardware::sensors::V1_0::SensorFlagBits;
+    using SharedMemType = ::android::hardware::sensors::V1_0::SharedMemType;
+
+    /**
+     * Claim the memory types of a sensor nobody owns yet for its subhal.
+     *
+     * @param flags The sensor flags as reported by the subhal.
+     * @param subHalIndex The index of the subhal the sensor came from.
+     * @return The flags without the memory types other subhals own, and without the direct
+     *         report rates if no memory type is left.
+     */
+    uint32_t claim(uint32_t flags, size_t subHalIndex) {
+        bool stripped = false;
+        for (size_t type = 0; type < kTypes.size(); type++) {
+            uint32_t bit = static_cast<uint32_t>(kTypes[type].second);
+            if ((flags & bit) == 0) {
+                continue;
+            }
+            if (!mOwners[type]) {
+                mOwners[type] = subHalIndex;
+            } else if (*mOwners[type] != subHalIndex) {
+                flags &= ~bit;
+                stripped = true;
+            }
+        }
+
+        if (stripped && (flags & static_cast<uint32_t>(SensorFlagBits::MASK_DIRECT_CHANNEL)) == 0) {
+            flags &= ~static_cast<uint32_t>(SensorFlagBits::MASK_DIRECT_REPORT);
+        }
+        return flags;
+    }
+
+    //! The subhal owning a memory type, if any.
+    std::optional<size_t> owner(SharedMemType memType) const {
+        for (size_t type = 0; type < kTypes.size(); type++) {
+            if (kTypes[type].first == memType) {
+                return mOwners[type];
+            }
+        }
+        return std::nullopt;
+    }
+
+    //! Whether no subhal supports direct channels at all.
+    bool empty() const {
+        for (const auto& owner : mOwners) {
+            if (owner) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    static constexpr std::array<std::pair<SharedMemType, SensorFlagBits>, 2> kTypes = {{
+            {SharedMemType::ASHMEM, SensorFlagBits::DIRECT_CHANNEL_ASHMEM},
+            {SharedMemType::GRALLOC, SensorFlagBits::DIRECT_CHANNEL_GRALLOC},
+    }};
+
+    //! The owning subhal index for each entry of kTypes.
+    std::array<std::optional<size_t>, 2> mOwners;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android/hardware/sensors/2.1/types.h>
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/**
+ * The dynamic sensors connected through the subhals, by proxy sensor handle. Subhals post
+ * events from their own threads while sensors come and go, so nothing hands out references
+ * into the list; lookups return copies taken under the lock.
+ */
+class DynamicSensorList {
+  public:
+    using SensorInfo = ::android::hardware::sensors::V2_1::SensorInfo;
+
+    void add(const SensorInfo& sensor) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mSensors[sensor.sensorHandle] = sensor;
+    }
+
+    //! Returns whether the sensor was connected.
+    bool remove(int32_t sensorHandle) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mSensors.erase(sensorHandle) > 0;
+    }
+
+    std::optional<SensorInfo> find(int32_t sensorHandle) const {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto sensor = mSensors.find(sensorHandle);
+        if (sensor == mSensors.end()) {
+            return std::nullopt;
+        }
+        return sensor->second;
+    }
+
+    //! The flags of a sensor, without copying the rest of it.
+    std::optional<uint32_t> flags(int32_t sensorHandle) const {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto sensor = mSensors.find(sensorHandle);
+        if (sensor == mSensors.end()) {
+            return std::nullopt;
+        }
+        return sensor->second.flags;
+    }
+
+    std::vector<int32_t> handles() const {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::vector<int32_t> sensorHandles;
+        sensorHandles.reserve(mSensors.size());
+        for (const auto& [sensorHandle, sensor] : mSensors) {
+            sensorHandles.push_back(sensorHandle);
+        }
+        return sensorHandles;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mSensors.size();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mSensors.clear();
+    }
+
+  private:
+    mutable std::mutex mLock;
+    std::map<int32_t, SensorInfo> mSensors;
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
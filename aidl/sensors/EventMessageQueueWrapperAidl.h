@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ConvertUtils.h"
+#include "EventMessageQueueWrapper.h"
+#include "fmq/AidlMessageQueue.h"
+#include "fmq/EventFlag.h"
+#include "fmq/MessageQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace implementation {
+
+/**
+ * Counters for the two ways events reach the AIDL event FMQ, kept outside the wrapper so they
+ * survive re-initialization. Only one in kTimedBatchInterval batches is timed, *TimedEvents
+ * counts the events in those.
+ */
+struct EventWriteStats {
+    static constexpr uint64_t kTimedBatchInterval = 64;
+
+    //! Events converted straight into FMQ slots by write().
+    std::atomic<uint64_t> directEvents = 0;
+    std::atomic<uint64_t> directBatches = 0;
+    std::atomic<uint64_t> directTimedEvents = 0;
+    std::atomic<uint64_t> directNs = 0;
+
+    //! Events converted into a staging buffer first, for writeBlocking().
+    std::atomic<uint64_t> bufferedEvents = 0;
+    std::atomic<uint64_t> bufferedBatches = 0;
+    std::atomic<uint64_t> bufferedTimedEvents = 0;
+    std::atomic<uint64_t> bufferedNs = 0;
+};
+
+class EventMessageQueueWrapperAidl
+    : public ::android::hardware::sensors::V2_1::implementation::EventMessageQueueWrapperBase {
+  public:
+    using AidlEventQueue = ::android::AidlMessageQueue<
+            ::aidl::android::hardware::sensors::Event,
+            ::aidl::android::hardware::common::fmq::SynchronizedReadWrite>;
+
+    EventMessageQueueWrapperAidl(std::unique_ptr<AidlEventQueue>& queue,
+                                 EventWriteStats* stats = nullptr)
+        : mQueue(std::move(queue)), mStats(stats) {}
+
+    virtual std::atomic<uint32_t>* getEventFlagWord() override {
+        return mQueue->getEventFlagWord();
+    }
+
+    virtual size_t availableToRead() override { return mQueue->availableToRead(); }
+
+    size_t availableToWrite() override { return mQueue->availableToWrite(); }
+
+    virtual bool read(::android::hardware::sensors::V2_1::Event* events,
+                      size_t numToRead) override {
+        mIntermediateEventBuffer.resize(numToRead);
+        bool success = mQueue->read(mIntermediateEventBuffer.data(), numToRead);
+        for (size_t i = 0; i < numToRead; ++i) {
+            convertToHidlEvent(mIntermediateEventBuffer[i], &events[i]);
+        }
+        return success;
+    }
+
+    /**
+     * Converts the events once, directly into the FMQ slots, then commits them as one batch.
+     * Writes nothing if they don't all fit.
+     */
+    bool write(const ::android::hardware::sensors::V2_1::Event* events,
+               size_t numToWrite) override {
+        std::chrono::steady_clock::time_point start;
+        const bool timed = startTiming(&start);
+
+        AidlEventQueue::MemTransaction tx;
+        if (!mQueue->beginWrite(numToWrite, &tx)) {
+            return false;
+        }
+
+        size_t i = 0;
+        for (const auto* region : {&tx.getFirstRegion(), &tx.getSecondRegion()}) {
+            ::aidl::android::hardware::sensors::Event* slots = region->getAddress();
+            for (size_t slot = 0; slot < region->getLength(); ++slot) {
+                convertToAidlEvent(events[i++], &slots[slot]);
+            }
+        }
+        bool success = mQueue->commitWrite(numToWrite);
+
+        if (mStats != nullptr) {
+            record(&mStats->directEvents, &mStats->directBatches, &mStats->directTimedEvents,
+                   &mStats->directNs, numToWrite, timed ? &start : nullptr);
+        }
+        return success;
+    }
+
+    virtual bool write(
+            const std::vector<::android::hardware::sensors::V2_1::Event>& events) override {
+        return write(events.data(), events.size());
+    }
+
+    bool writeBlocking(const ::android::hardware::sensors::V2_1::Event* events, size_t count,
+                       uint32_t readNotification, uint32_t writeNotification,
+                       int64_t timeOutNanos,
+                       ::android::hardware::EventFlag* evFlag) override {
+        std::chrono::steady_clock::time_point start;
+        const bool timed = startTiming(&start);
+
+        // The reader has to make room first, so there are no slots to convert into yet
+        mIntermediateEventBuffer.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            convertToAidlEvent(events[i], &mIntermediateEventBuffer[i]);
+        }
+        bool success = mQueue->writeBlocking(mIntermediateEventBuffer.data(), count,
+                                             readNotification, writeNotification, timeOutNanos,
+                                             evFlag);
+
+        if (mStats != nullptr) {
+            record(&mStats->bufferedEvents, &mStats->bufferedBatches,
+                   &mStats->bufferedTimedEvents, &mStats->bufferedNs, count,
+                   timed ? &start : nullptr);
+        }
+        return success;
+    }
+
+    size_t getQuantumCount() override { return mQueue->getQuantumCount(); }
+
+  private:
+    //! Reads the clock for one in kTimedBatchInterval batches, the rest skip it entirely.
+    bool startTiming(std::chrono::steady_clock::time_point* start) {
+        if (mStats == nullptr || mBatches++ % EventWriteStats::kTimedBatchInterval != 0) {
+            return false;
+        }
+        *start = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    static void record(std::atomic<uint64_t>* events, std::atomic<uint64_t>* batches,
+                       std::atomic<uint64_t>* timedEvents, std::atomic<uint64_t>* ns,
+                       size_t count, const std::chrono::steady_clock::time_point* start) {
+        events->fetch_add(count, std::memory_order_relaxed);
+        batches->fetch_add(1, std::memory_order_relaxed);
+        if (start != nullptr) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - *start);
+            timedEvents->fetch_add(count, std::memory_order_relaxed);
+            ns->fetch_add(elapsed.count(), std::memory_order_relaxed);
+        }
+    }
+
+    std::unique_ptr<AidlEventQueue> mQueue;
+    EventWriteStats* mStats;
+    //! Writes are serialized by the HalProxy event queue lock.
+    uint64_t mBatches = 0;
+
+    //! Staging for reads and blocking writes, which can't use the FMQ slots directly.
+    std::vector<::aidl::android::hardware::sensors::Event> mIntermediateEventBuffer;
+};
+
+}  // namespace implementation
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -23,10 +23,13 @@
 
 #include <dlfcn.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cinttypes>
 #include <cmath>
 #include <fstream>
 #include <functional>
+#include <numeric>
 #include <thread>
 
 namespace android {
@@ -36,6 +39,7 @@ namespace V2_1 {
 namespace implementation {
 
 using ::android::hardware::sensors::V1_0::Result;
+using ::android::hardware::sensors::V1_0::SharedMemType;
 using ::android::hardware::sensors::V2_0::EventQueueFlagBits;
 using ::android::hardware::sensors::V2_0::WakeLockQueueFlagBits;
 using ::android::hardware::sensors::V2_0::implementation::getTimeNow;
@@ -156,22 +160,40 @@ Return<void> HalProxy::getSensorsList(ISensorsV2_0::getSensorsList_cb _hidl_cb)
 }
 
 Return<Result> HalProxy::setOperationMode(OperationMode mode) {
+    // Subhals may reset or reprogram sensors when switching, even when rolled back
+    invalidateSensorConfigs();
+
+    std::vector<size_t> subHalIndices(mSubHalList.size());
+    std::iota(subHalIndices.begin(), subHalIndices.end(), 0);
+
+    std::vector<Result> results(mSubHalList.size(), Result::OK);
+    forEachSubHalInParallel(subHalIndices, &SubHalTimings::setOperationMode,
+                            [&](size_t subHalIndex) {
+                                results[subHalIndex] =
+                                        mSubHalList[subHalIndex]->setOperationMode(mode);
+                            });
+
     Result result = Result::OK;
-    size_t subHalIndex;
-    for (subHalIndex = 0; subHalIndex < mSubHalList.size(); subHalIndex++) {
-        result = mSubHalList[subHalIndex]->setOperationMode(mode);
-        if (result != Result::OK) {
+    std::vector<size_t> flipped;
+    for (size_t subHalIndex : subHalIndices) {
+        if (results[subHalIndex] == Result::OK) {
+            flipped.push_back(subHalIndex);
+        } else {
             ALOGE("setOperationMode failed for SubHal: %s",
                   mSubHalList[subHalIndex]->getName().c_str());
-            break;
+            if (result == Result::OK) {
+                result = results[subHalIndex];
+            }
         }
     }
 
     if (result != Result::OK) {
         // Reset the subhal operation modes that have been flipped
-        for (size_t i = 0; i < subHalIndex; i++) {
-            mSubHalList[i]->setOperationMode(mCurrentOperationMode);
-        }
+        forEachSubHalInParallel(flipped, &SubHalTimings::setOperationMode,
+                                [&](size_t subHalIndex) {
+                                    mSubHalList[subHalIndex]->setOperationMode(
+                                            mCurrentOperationMode);
+                                });
     } else {
         mCurrentOperationMode = mode;
     }
@@ -182,8 +204,31 @@ Return<Result> HalProxy::activate(int32_t sensorHandle, bool enabled) {
     if (!isSubHalIndexValid(sensorHandle)) {
         return Result::BAD_VALUE;
     }
-    return getSubHalForSensorHandle(sensorHandle)
-            ->activate(clearSubHalIndex(sensorHandle), enabled);
+
+    // One-shot and special reporting sensors disarm themselves when they fire, so the last
+    // activate says nothing about whether they are still armed
+    bool disarmsItself = disarmsItselfOnEvent(sensorHandle);
+    if (!disarmsItself) {
+        std::lock_guard<std::mutex> lock(mSensorConfigsMutex);
+        auto config = mSensorConfigs.find(sensorHandle);
+        if (config != mSensorConfigs.end() && config->second.enabled == enabled) {
+            mSuppressedActivates++;
+            return Result::OK;
+        }
+    }
+
+    Result result = getSubHalForSensorHandle(sensorHandle)
+                            ->activate(clearSubHalIndex(sensorHandle), enabled);
+
+    std::lock_guard<std::mutex> lock(mSensorConfigsMutex);
+    if (result == Result::OK) {
+        if (!disarmsItself) {
+            mSensorConfigs[sensorHandle].enabled = enabled;
+        }
+    } else {
+        mSensorConfigs.erase(sensorHandle);
+    }
+    return result;
 }
 
 Return<Result> HalProxy::initialize_2_1(
@@ -241,15 +286,29 @@ Return<Result> HalProxy::initializeCommon(
 
     // So that the pending write events queue can be cleared safely and when we start threads
     // again we do not get new events until after initialize resets the subhals.
+    invalidateSensorConfigs();
     disableAllSensors();
 
     // Clears the queue if any events were pending write before.
-    mPendingWriteEventsQueue = std::queue<std::pair<std::vector<V2_1::Event>, size_t>>();
-    mSizePendingWriteEventsQueue = 0;
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        mPendingWriteEventsQueue = std::queue<std::pair<std::vector<V2_1::Event>, size_t>>();
+        mSizePendingWriteEventsQueue = 0;
+        mPendingWritesBarrier.reset();
+    }
 
     // Clears previously connected dynamic sensors
     mDynamicSensors.clear();
 
+    // Direct channels belong to the previous framework instance
+    {
+        std::lock_guard<std::mutex> lock(mDirectChannelMutex);
+        for (const auto& [channelHandle, channel] : mDirectChannels) {
+            unregisterDirectChannelSubHal(channel);
+        }
+        mDirectChannels.clear();
+    }
+
     mDynamicSensorsCallback = sensorsCallback;
 
     // Create the Event FMQ from the eventQueueDescriptor. Reset the read/write positions.
@@ -289,6 +348,8 @@ Return<Result> HalProxy::initializeCommon(
         }
     }
 
+    // The subhals start over from their defaults
+    invalidateSensorConfigs();
     mCurrentOperationMode = OperationMode::NORMAL;
 
     return result;
@@ -299,8 +360,28 @@ Return<Result> HalProxy::batch(int32_t sensorHandle, int64_t samplingPeriodNs,
     if (!isSubHalIndexValid(sensorHandle)) {
         return Result::BAD_VALUE;
     }
-    return getSubHalForSensorHandle(sensorHandle)
-            ->batch(clearSubHalIndex(sensorHandle), samplingPeriodNs, maxReportLatencyNs);
+
+    auto batch = std::make_pair(samplingPeriodNs, maxReportLatencyNs);
+    {
+        std::lock_guard<std::mutex> lock(mSensorConfigsMutex);
+        auto config = mSensorConfigs.find(sensorHandle);
+        if (config != mSensorConfigs.end() && config->second.batch == batch) {
+            mSuppressedBatches++;
+            return Result::OK;
+        }
+    }
+
+    Result result = getSubHalForSensorHandle(sensorHandle)
+                            ->batch(clearSubHalIndex(sensorHandle), samplingPeriodNs,
+                                    maxReportLatencyNs);
+
+    std::lock_guard<std::mutex> lock(mSensorConfigsMutex);
+    if (result == Result::OK) {
+        mSensorConfigs[sensorHandle].batch = batch;
+    } else {
+        mSensorConfigs.erase(sensorHandle);
+    }
+    return result;
 }
 
 Return<Result> HalProxy::flush(int32_t sensorHandle) {
@@ -336,38 +417,80 @@ Return<Result> HalProxy::injectSensorData(const V1_0::Event& event) {
 
 Return<void> HalProxy::registerDirectChannel(const SharedMemInfo& mem,
                                              ISensorsV2_0::registerDirectChannel_cb _hidl_cb) {
-    if (mDirectChannelSubHal == nullptr) {
+    std::lock_guard<std::mutex> lock(mDirectChannelMutex);
+    if (mDirectChannelOwners.empty()) {
         _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
-    } else {
-        mDirectChannelSubHal->registerDirectChannel(mem, _hidl_cb);
+        return Return<void>();
     }
+
+    std::optional<size_t> subHalIndex = mDirectChannelOwners.owner(mem.type);
+    if (!subHalIndex) {
+        _hidl_cb(Result::BAD_VALUE, -1 /* channelHandle */);
+        return Return<void>();
+    }
+
+    Result result = Result::INVALID_OPERATION;
+    int32_t subHalChannelHandle = -1;
+    mSubHalList[*subHalIndex]->registerDirectChannel(
+            mem, [&](Result subHalResult, int32_t subHalChannel) {
+                result = subHalResult;
+                subHalChannelHandle = subHalChannel;
+            });
+    if (result != Result::OK) {
+        _hidl_cb(result, -1 /* channelHandle */);
+        return Return<void>();
+    }
+
+    // Subhals number their channels independently, so the framework gets proxy handles
+    int32_t channelHandle = mNextDirectChannelHandle++;
+    mDirectChannels[channelHandle] = {*subHalIndex, subHalChannelHandle};
+    _hidl_cb(Result::OK, channelHandle);
     return Return<void>();
 }
 
 Return<Result> HalProxy::unregisterDirectChannel(int32_t channelHandle) {
-    Result result;
-    if (mDirectChannelSubHal == nullptr) {
-        result = Result::INVALID_OPERATION;
-    } else {
-        result = mDirectChannelSubHal->unregisterDirectChannel(channelHandle);
+    std::lock_guard<std::mutex> lock(mDirectChannelMutex);
+    if (mDirectChannelOwners.empty()) {
+        return Result::INVALID_OPERATION;
     }
-    return result;
+
+    auto channel = mDirectChannels.find(channelHandle);
+    if (channel == mDirectChannels.end()) {
+        return Result::BAD_VALUE;
+    }
+
+    unregisterDirectChannelSubHal(channel->second);
+    mDirectChannels.erase(channel);
+    return Result::OK;
 }
 
 Return<void> HalProxy::configDirectReport(int32_t sensorHandle, int32_t channelHandle,
                                           RateLevel rate,
                                           ISensorsV2_0::configDirectReport_cb _hidl_cb) {
-    if (mDirectChannelSubHal == nullptr) {
+    std::lock_guard<std::mutex> lock(mDirectChannelMutex);
+    if (mDirectChannelOwners.empty()) {
         _hidl_cb(Result::INVALID_OPERATION, -1 /* reportToken */);
-    } else if (sensorHandle == -1 && rate != RateLevel::STOP) {
+        return Return<void>();
+    }
+
+    auto channel = mDirectChannels.find(channelHandle);
+    if (channel == mDirectChannels.end() || (sensorHandle == -1 && rate != RateLevel::STOP)) {
         _hidl_cb(Result::BAD_VALUE, -1 /* reportToken */);
-    } else {
-        // -1 denotes all sensors should be disabled
-        if (sensorHandle != -1) {
-            sensorHandle = clearSubHalIndex(sensorHandle);
+        return Return<void>();
+    }
+
+    // -1 denotes all sensors should be disabled
+    if (sensorHandle != -1) {
+        // Only sensors of the owning subhal advertise the memory type of the channel
+        if (!isSubHalIndexValid(sensorHandle) ||
+            extractSubHalIndex(sensorHandle) != channel->second.subHalIndex) {
+            _hidl_cb(Result::BAD_VALUE, -1 /* reportToken */);
+            return Return<void>();
         }
-        mDirectChannelSubHal->configDirectReport(sensorHandle, channelHandle, rate, _hidl_cb);
+        sensorHandle = clearSubHalIndex(sensorHandle);
     }
+    mSubHalList[channel->second.subHalIndex]->configDirectReport(
+            sensorHandle, channel->second.subHalChannelHandle, rate, _hidl_cb);
     return Return<void>();
 }
 
@@ -398,11 +521,47 @@ Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&
         stream << "  Size of events list on front of pending writes queue: "
                << mPendingWriteEventsQueue.front().first.size() << std::endl;
     }
+    {
+        std::lock_guard<std::mutex> lock(mSensorConfigsMutex);
+        stream << "  # of cached sensor configs: " << mSensorConfigs.size()
+               << ", suppressed activates: " << mSuppressedActivates
+               << ", suppressed batches: " << mSuppressedBatches << std::endl;
+    }
+    stream << "  Dynamic sensor disconnects waiting on pending writes: "
+           << mPendingWritesBarrier.waits() << ", timed out: " << mPendingWritesBarrier.timeouts()
+           << ", max wait: " << msFromNs(mPendingWritesBarrier.maxWait().count()) << " ms"
+           << std::endl;
     stream << "  # of non-dynamic sensors across all subhals: " << mSensors.size() << std::endl;
     stream << "  # of dynamic sensors across all subhals: " << mDynamicSensors.size() << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(mDirectChannelMutex);
+        for (auto memType : {SharedMemType::ASHMEM, SharedMemType::GRALLOC}) {
+            std::optional<size_t> owner = mDirectChannelOwners.owner(memType);
+            stream << "  Direct channel " << toString(memType) << " owner: "
+                   << (owner ? mSubHalList[*owner]->getName() : "none") << std::endl;
+        }
+        stream << "  # of direct channels: " << mDirectChannels.size() << std::endl;
+        for (const auto& [channelHandle, channel] : mDirectChannels) {
+            stream << "    Channel " << channelHandle << ": "
+                   << mSubHalList[channel.subHalIndex]->getName() << " channel "
+                   << channel.subHalChannelHandle << std::endl;
+        }
+    }
     stream << "SubHals (" << mSubHalList.size() << "):" << std::endl;
-    for (auto& subHal : mSubHalList) {
+    for (size_t subHalIndex = 0; subHalIndex < mSubHalList.size(); subHalIndex++) {
+        auto& subHal = mSubHalList[subHalIndex];
         stream << "  Name: " << subHal->getName() << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(mSubHalTimingsMutex);
+            const SubHalTimings& timings = mSubHalTimings[subHalIndex];
+            for (const auto& [name, timing] :
+                 {std::make_pair("setOperationMode", &timings.setOperationMode),
+                  std::make_pair("disableAllSensors", &timings.disableAllSensors)}) {
+                stream << "  " << name << ": " << timing->calls << " calls, last "
+                       << timing->lastNs / 1000 << " us, max " << timing->maxNs / 1000 << " us"
+                       << std::endl;
+            }
+        }
         stream << "  Debug dump: " << std::endl;
         android::base::WriteStringToFd(stream.str(), writeFd);
         subHal->debug(fd, args);
@@ -416,17 +575,14 @@ Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&
 Return<void> HalProxy::onDynamicSensorsConnected(const hidl_vec<SensorInfo>& dynamicSensorsAdded,
                                                  int32_t subHalIndex) {
     std::vector<SensorInfo> sensors;
-    {
-        std::lock_guard<std::mutex> lock(mDynamicSensorsMutex);
-        for (SensorInfo sensor : dynamicSensorsAdded) {
-            if (!subHalIndexIsClear(sensor.sensorHandle)) {
-                ALOGE("Dynamic sensor added %s had sensorHandle with first byte not 0.",
-                      sensor.name.c_str());
-            } else {
-                sensor.sensorHandle = setSubHalIndex(sensor.sensorHandle, subHalIndex);
-                mDynamicSensors[sensor.sensorHandle] = sensor;
-                sensors.push_back(sensor);
-            }
+    for (SensorInfo sensor : dynamicSensorsAdded) {
+        if (!subHalIndexIsClear(sensor.sensorHandle)) {
+            ALOGE("Dynamic sensor added %s had sensorHandle with first byte not 0.",
+                  sensor.name.c_str());
+        } else {
+            sensor.sensorHandle = setSubHalIndex(sensor.sensorHandle, subHalIndex);
+            mDynamicSensors.add(sensor);
+            sensors.push_back(sensor);
         }
     }
     mDynamicSensorsCallback->onDynamicSensorsConnected(sensors);
@@ -435,22 +591,26 @@ Return<void> HalProxy::onDynamicSensorsConnected(const hidl_vec<SensorInfo>& dyn
 
 Return<void> HalProxy::onDynamicSensorsDisconnected(
         const hidl_vec<int32_t>& dynamicSensorHandlesRemoved, int32_t subHalIndex) {
-    // TODO(b/143302327): Block this call until all pending events are flushed from queue
+    // Events of the removed sensors may still be waiting to be written
+    waitForPendingWrites();
+
     std::vector<int32_t> sensorHandles;
-    {
-        std::lock_guard<std::mutex> lock(mDynamicSensorsMutex);
-        for (int32_t sensorHandle : dynamicSensorHandlesRemoved) {
-            if (!subHalIndexIsClear(sensorHandle)) {
-                ALOGE("Dynamic sensorHandle removed had first byte not 0.");
-            } else {
-                sensorHandle = setSubHalIndex(sensorHandle, subHalIndex);
-                if (mDynamicSensors.find(sensorHandle) != mDynamicSensors.end()) {
-                    mDynamicSensors.erase(sensorHandle);
-                    sensorHandles.push_back(sensorHandle);
-                }
+    for (int32_t sensorHandle : dynamicSensorHandlesRemoved) {
+        if (!subHalIndexIsClear(sensorHandle)) {
+            ALOGE("Dynamic sensorHandle removed had first byte not 0.");
+        } else {
+            sensorHandle = setSubHalIndex(sensorHandle, subHalIndex);
+            if (mDynamicSensors.remove(sensorHandle)) {
+                sensorHandles.push_back(sensorHandle);
             }
         }
     }
+    {
+        std::lock_guard<std::mutex> lock(mSensorConfigsMutex);
+        for (int32_t sensorHandle : sensorHandles) {
+            mSensorConfigs.erase(sensorHandle);
+        }
+    }
     mDynamicSensorsCallback->onDynamicSensorsDisconnected(sensorHandles);
     return Return<void>();
 }
@@ -515,7 +675,7 @@ void HalProxy::initializeSensorList() {
                 } else {
                     ALOGV("Loaded sensor: %s", sensor.name.c_str());
                     sensor.sensorHandle = setSubHalIndex(sensor.sensorHandle, subHalIndex);
-                    setDirectChannelFlags(&sensor, mSubHalList[subHalIndex]);
+                    setDirectChannelFlags(&sensor, subHalIndex);
                     bool keep = patchXiaomiPickupSensor(sensor);
                     if (!keep) {
                         continue;
@@ -552,6 +712,7 @@ void* HalProxy::getHandleForSubHalSharedObject(const std::string& filename) {
 }
 
 void HalProxy::init() {
+    mSubHalTimings.resize(mSubHalList.size());
     initializeSensorList();
 }
 
@@ -570,6 +731,10 @@ void HalProxy::stopThreads() {
     }
     mWakelockCV.notify_one();
     mEventQueueWriteCV.notify_one();
+    {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+        mPendingWritesBarrier.wake();
+    }
     if (mPendingWritesThread.joinable()) {
         mPendingWritesThread.join();
     }
@@ -579,14 +744,67 @@ void HalProxy::stopThreads() {
 }
 
 void HalProxy::disableAllSensors() {
+    std::vector<std::vector<int32_t>> sensorHandlesBySubHal(mSubHalList.size());
     for (const auto& sensorEntry : mSensors) {
         int32_t sensorHandle = sensorEntry.first;
-        activate(sensorHandle, false /* enabled */);
+        sensorHandlesBySubHal[extractSubHalIndex(sensorHandle)].push_back(sensorHandle);
     }
-    std::lock_guard<std::mutex> dynamicSensorsLock(mDynamicSensorsMutex);
-    for (const auto& sensorEntry : mDynamicSensors) {
-        int32_t sensorHandle = sensorEntry.first;
-        activate(sensorHandle, false /* enabled */);
+    // Not activated under the lock, subhals may post events from activate, which looks up
+    // dynamic sensors
+    for (int32_t sensorHandle : mDynamicSensors.handles()) {
+        if (isSubHalIndexValid(sensorHandle)) {
+            sensorHandlesBySubHal[extractSubHalIndex(sensorHandle)].push_back(sensorHandle);
+        }
+    }
+
+    std::vector<size_t> subHalIndices;
+    for (size_t subHalIndex = 0; subHalIndex < sensorHandlesBySubHal.size(); subHalIndex++) {
+        if (!sensorHandlesBySubHal[subHalIndex].empty()) {
+            subHalIndices.push_back(subHalIndex);
+        }
+    }
+
+    forEachSubHalInParallel(subHalIndices, &SubHalTimings::disableAllSensors,
+                            [&](size_t subHalIndex) {
+                                for (int32_t sensorHandle : sensorHandlesBySubHal[subHalIndex]) {
+                                    activate(sensorHandle, false /* enabled */);
+                                }
+                            });
+}
+
+void HalProxy::invalidateSensorConfigs() {
+    std::lock_guard<std::mutex> lock(mSensorConfigsMutex);
+    mSensorConfigs.clear();
+}
+
+void HalProxy::forEachSubHalInParallel(const std::vector<size_t>& subHalIndices,
+                                       SubHalCallTiming SubHalTimings::*timing,
+                                       const std::function<void(size_t)>& call) {
+    auto timedCall = [&](size_t subHalIndex) {
+        int64_t start = getTimeNow();
+        call(subHalIndex);
+        int64_t elapsed = getTimeNow() - start;
+
+        std::lock_guard<std::mutex> lock(mSubHalTimingsMutex);
+        SubHalCallTiming& subHalTiming = mSubHalTimings[subHalIndex].*timing;
+        subHalTiming.calls++;
+        subHalTiming.lastNs = elapsed;
+        subHalTiming.maxNs = std::max(subHalTiming.maxNs, elapsed);
+    };
+
+    if (subHalIndices.empty()) {
+        return;
+    }
+
+    // The calling thread takes the first subhal itself
+    std::vector<std::thread> threads;
+    threads.reserve(subHalIndices.size() - 1);
+    for (size_t i = 1; i < subHalIndices.size(); i++) {
+        threads.emplace_back(timedCall, subHalIndices[i]);
+    }
+    timedCall(subHalIndices[0]);
+    for (std::thread& thread : threads) {
+        thread.join();
     }
 }
 
@@ -631,11 +849,21 @@ void HalProxy::handlePendingWrites() {
                                          pendingWriteEvents.begin() + eventQueueSize);
             } else {
                 mPendingWriteEventsQueue.pop();
+                mPendingWritesBarrier.done();
             }
         }
     }
 }
 
+void HalProxy::waitForPendingWrites() {
+    std::unique_lock<std::mutex> lock(mEventQueueWriteMutex);
+    if (!mPendingWritesBarrier.wait(lock, std::chrono::nanoseconds(kPendingWriteTimeoutNs),
+                                    [&] { return !mThreadsRun.load(); })) {
+        ALOGW("Timed out waiting for pending writes, %" PRIu64 " still queued.",
+              mPendingWritesBarrier.outstanding());
+    }
+}
+
 void HalProxy::startWakelockThread(HalProxy* halProxy) {
     halProxy->handleWakelocks();
 }
@@ -707,6 +935,7 @@ void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t
         mSizePendingWriteEventsQueue + numLeft <= kMaxSizePendingWriteEventsQueue) {
         std::vector<Event> eventsLeft(events.begin() + numToWrite, events.end());
         mPendingWriteEventsQueue.push({eventsLeft, numWakeupEvents});
+        mPendingWritesBarrier.enqueued();
         mSizePendingWriteEventsQueue += numLeft;
         mMostEventsObservedPendingWriteEventsQueue =
                 std::max(mMostEventsObservedPendingWriteEventsQueue, mSizePendingWriteEventsQueue);
@@ -746,18 +975,18 @@ void HalProxy::decrementRefCountAndMaybeReleaseWakelock(size_t delta,
     }
 }
 
-void HalProxy::setDirectChannelFlags(SensorInfo* sensorInfo,
-                                     std::shared_ptr<ISubHalWrapperBase> subHal) {
-    bool sensorSupportsDirectChannel =
-            (sensorInfo->flags & (V1_0::SensorFlagBits::MASK_DIRECT_REPORT |
-                                  V1_0::SensorFlagBits::MASK_DIRECT_CHANNEL)) != 0;
-    if (mDirectChannelSubHal == nullptr && sensorSupportsDirectChannel) {
-        mDirectChannelSubHal = subHal;
-    } else if (mDirectChannelSubHal != nullptr && subHal != mDirectChannelSubHal) {
-        // disable direct channel capability for sensors in subHals that are not
-        // the only one we will enable
-        sensorInfo->flags &= ~(V1_0::SensorFlagBits::MASK_DIRECT_REPORT |
-                               V1_0::SensorFlagBits::MASK_DIRECT_CHANNEL);
+void HalProxy::setDirectChannelFlags(SensorInfo* sensorInfo, size_t subHalIndex) {
+    sensorInfo->flags = mDirectChannelOwners.claim(sensorInfo->flags, subHalIndex);
+}
+
+void HalProxy::unregisterDirectChannelSubHal(const DirectChannel& channel) {
+    Result result =
+            mSubHalList[channel.subHalIndex]->unregisterDirectChannel(channel.subHalChannelHandle);
+    if (result != Result::OK) {
+        ALOGW("SubHal '%s' failed to unregister direct channel %" PRId32 " with reason %" PRId32
+              ".",
+              mSubHalList[channel.subHalIndex]->getName().c_str(), channel.subHalChannelHandle,
+              static_cast<int32_t>(result));
     }
 }
 
@@ -769,11 +998,39 @@ bool HalProxy::isSubHalIndexValid(int32_t sensorHandle) {
     return extractSubHalIndex(sensorHandle) < mSubHalList.size();
 }
 
+const HalProxy::SensorInfo& HalProxy::getSensorInfo(int32_t sensorHandle) {
+    auto sensor = mSensors.find(sensorHandle);
+    if (sensor != mSensors.end()) {
+        return sensor->second;
+    }
+
+    // A dynamic sensor can disconnect as soon as the lookup returns, so hand out a copy
+    // owned by the calling thread. It stays valid until that thread looks up another sensor.
+    thread_local SensorInfo dynamicSensor;
+    dynamicSensor = mDynamicSensors.find(sensorHandle).value_or(SensorInfo{});
+    return dynamicSensor;
+}
+
+uint32_t HalProxy::getSensorFlags(int32_t sensorHandle) {
+    auto sensor = mSensors.find(sensorHandle);
+    if (sensor != mSensors.end()) {
+        return sensor->second.flags;
+    }
+    return mDynamicSensors.flags(sensorHandle).value_or(0);
+}
+
+bool HalProxy::disarmsItselfOnEvent(int32_t sensorHandle) {
+    uint32_t reportingMode = getSensorFlags(sensorHandle) &
+                             static_cast<uint32_t>(V1_0::SensorFlagBits::MASK_REPORTING_MODE);
+    return reportingMode == static_cast<uint32_t>(V1_0::SensorFlagBits::ONE_SHOT_MODE) ||
+           reportingMode == static_cast<uint32_t>(V1_0::SensorFlagBits::SPECIAL_REPORTING_MODE);
+}
+
 size_t HalProxy::countNumWakeupEvents(const std::vector<Event>& events, size_t n) {
     size_t numWakeupEvents = 0;
     for (size_t i = 0; i < n; i++) {
-        int32_t sensorHandle = events[i].sensorHandle;
-        if (mSensors[sensorHandle].flags & static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) {
+        if (getSensorFlags(events[i].sensorHandle) &
+            static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP)) {
             numWakeupEvents++;
         }
     }
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_1 {
+namespace implementation {
+
+/**
+ * Lets a caller wait for the entries on the pending write events queue right now to be written
+ * or dropped. Each entry pushed gets the next enqueued sequence number and entries leave in
+ * order, so every entry up to the done sequence number is gone. Entries pushed after a wait
+ * started don't extend it.
+ *
+ * Everything is called with the lock guarding the pending write events queue held.
+ */
+class PendingWritesBarrier {
+  public:
+    //! An entry was pushed onto the queue.
+    void enqueued() { mEnqueued++; }
+
+    //! The entry at the front of the queue was popped.
+    void done() {
+        mDone++;
+        mCV.notify_all();
+    }
+
+    //! The queue was cleared.
+    void reset() {
+        mDone = mEnqueued;
+        mCV.notify_all();
+    }
+
+    //! Wakes up waiters so they can check whether they were stopped.
+    void wake() { mCV.notify_all(); }
+
+    /**
+     * Block until the entries queued before this call are done, stopped() returns true or the
+     * timeout expires.
+     *
+     * @return false if the timeout expired.
+     */
+    template <typename Stopped>
+    bool wait(std::unique_lock<std::mutex>& lock, std::chrono::nanoseconds timeout,
+              Stopped stopped) {
+        uint64_t barrier = mEnqueued;
+        if (mDone >= barrier) {
+            return true;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool done = mCV.wait_for(lock, timeout, [&] { return mDone >= barrier || stopped(); });
+        auto waited = std::chrono::steady_clock::now() - start;
+
+        mWaits++;
+        mMaxWait = std::max<std::chrono::nanoseconds>(mMaxWait, waited);
+        if (!done) {
+            mTimeouts++;
+        }
+        return done;
+    }
+
+    //! Entries queued and not done yet.
+    uint64_t outstanding() const { return mEnqueued - mDone; }
+
+    size_t waits() const { return mWaits; }
+    size_t timeouts() const { return mTimeouts; }
+    std::chrono::nanoseconds maxWait() const { return mMaxWait; }
+
+  private:
+    uint64_t mEnqueued = 0;
+    uint64_t mDone = 0;
+    std::condition_variable mCV;
+
+    //! Waits that found entries outstanding, and for how long
+    size_t mWaits = 0;
+    size_t mTimeouts = 0;
+    std::chrono::nanoseconds mMaxWait{0};
+};
+
+}  // namespace implementation
+}  // namespace V2_1
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
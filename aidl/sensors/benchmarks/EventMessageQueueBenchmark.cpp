@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "EventMessageQueueWrapperAidl.h"
+
+using ::aidl::android::hardware::sensors::implementation::convertToAidlEvent;
+using ::aidl::android::hardware::sensors::implementation::EventMessageQueueWrapperAidl;
+using ::aidl::android::hardware::sensors::implementation::EventWriteStats;
+using ::android::hardware::sensors::V2_1::Event;
+using ::android::hardware::sensors::V2_1::SensorType;
+
+using AidlEventQueue = EventMessageQueueWrapperAidl::AidlEventQueue;
+
+namespace {
+
+// Same size the framework hands the multi-HAL, in events
+constexpr size_t kQueueSize = 1024;
+
+std::vector<Event> makeEvents(size_t count) {
+    std::vector<Event> events(count);
+    for (size_t i = 0; i < count; i++) {
+        events[i].sensorHandle = 1;
+        events[i].sensorType = SensorType::ACCELEROMETER;
+        events[i].timestamp = i * 1000000;
+        events[i].u.vec3.x = 0.1f * i;
+        events[i].u.vec3.y = 9.8f;
+        events[i].u.vec3.z = -0.1f * i;
+    }
+    return events;
+}
+
+// Frees the slots without converting them back, so only the write side is measured
+void drain(AidlEventQueue* reader, size_t count) {
+    AidlEventQueue::MemTransaction tx;
+    if (reader->beginRead(count, &tx)) {
+        reader->commitRead(count);
+    }
+}
+
+// What the upstream wrapper did: convert into a staging array, then copy it into the FMQ
+void BM_WriteStaged(benchmark::State& state) {
+    const size_t count = state.range(0);
+    std::vector<Event> events = makeEvents(count);
+
+    AidlEventQueue queue(kQueueSize, true /* configureEventFlagWord */);
+    AidlEventQueue reader(queue.dupeDesc(), false /* resetPointers */);
+    std::vector<::aidl::android::hardware::sensors::Event> staging(count);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < count; i++) {
+            convertToAidlEvent(events[i], &staging[i]);
+        }
+        if (!queue.write(staging.data(), count)) {
+            state.SkipWithError("write failed");
+            return;
+        }
+        drain(&reader, count);
+    }
+
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_WriteStaged)->RangeMultiplier(2)->Range(1, 128);
+
+void BM_WriteDirect(benchmark::State& state) {
+    const size_t count = state.range(0);
+    std::vector<Event> events = makeEvents(count);
+
+    auto queue = std::make_unique<AidlEventQueue>(kQueueSize, true /* configureEventFlagWord */);
+    AidlEventQueue reader(queue->dupeDesc(), false /* resetPointers */);
+    EventMessageQueueWrapperAidl wrapper(queue);
+
+    for (auto _ : state) {
+        if (!wrapper.write(events.data(), count)) {
+            state.SkipWithError("write failed");
+            return;
+        }
+        drain(&reader, count);
+    }
+
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_WriteDirect)->RangeMultiplier(2)->Range(1, 128);
+
+// Aggregate event rate of a few sensors running at their fastest, in events per second
+constexpr int64_t kPacedRate = 1000;
+constexpr auto kPacedDuration = std::chrono::seconds(1);
+
+std::chrono::nanoseconds threadCpuTime() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+enum class PacedWriter { STAGED, DIRECT, DIRECT_WITH_STATS };
+
+/*
+ * Writes at kPacedRate in batches of range(0) events, the way sensor events trickle in rather
+ * than back to back, and reports the writing thread's CPU use in percent. A separate reader
+ * drains the queue every millisecond like the framework's event thread.
+ */
+template <PacedWriter kWriter>
+void BM_PacedCpu(benchmark::State& state) {
+    const size_t count = state.range(0);
+    const auto period = std::chrono::nanoseconds(std::chrono::seconds(1)) * count / kPacedRate;
+    std::vector<Event> events = makeEvents(count);
+
+    auto queue = std::make_unique<AidlEventQueue>(kQueueSize, true /* configureEventFlagWord */);
+    AidlEventQueue reader(queue->dupeDesc(), false /* resetPointers */);
+    AidlEventQueue* staged = queue.get();
+    std::vector<::aidl::android::hardware::sensors::Event> staging(count);
+
+    EventWriteStats stats;
+    EventMessageQueueWrapperAidl wrapper(
+            queue, kWriter == PacedWriter::DIRECT_WITH_STATS ? &stats : nullptr);
+
+    std::atomic<bool> done = false;
+    std::thread drainer([&] {
+        while (!done.load()) {
+            size_t available = reader.availableToRead();
+            if (available > 0) {
+                drain(&reader, available);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    double totalCpuPercent = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto cpuStart = threadCpuTime();
+
+        auto next = start;
+        while (next - start < kPacedDuration) {
+            bool written;
+            if constexpr (kWriter == PacedWriter::STAGED) {
+                for (size_t i = 0; i < count; i++) {
+                    convertToAidlEvent(events[i], &staging[i]);
+                }
+                written = staged->write(staging.data(), count);
+            } else {
+                written = wrapper.write(events.data(), count);
+            }
+            if (!written) {
+                state.SkipWithError("write failed, the reader fell behind");
+                break;
+            }
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+
+        const auto wall = std::chrono::steady_clock::now() - start;
+        totalCpuPercent += 100.0 * (threadCpuTime() - cpuStart).count() / wall.count();
+    }
+
+    done = true;
+    drainer.join();
+
+    state.counters["cpu_pct"] = totalCpuPercent / std::max<int64_t>(state.iterations(), 1);
+    state.SetItemsProcessed(state.iterations() * kPacedRate);
+}
+BENCHMARK_TEMPLATE(BM_PacedCpu, PacedWriter::STAGED)
+        ->Arg(1)
+        ->Arg(16)
+        ->Iterations(3)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PacedCpu, PacedWriter::DIRECT)
+        ->Arg(1)
+        ->Arg(16)
+        ->Iterations(3)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PacedCpu, PacedWriter::DIRECT_WITH_STATS)
+        ->Arg(1)
+        ->Arg(16)
+        ->Iterations(3)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
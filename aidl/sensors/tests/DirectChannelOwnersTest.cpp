@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "DirectChannelOwners.h"
+
+using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V1_0::SharedMemType;
+using ::android::hardware::sensors::V2_1::implementation::DirectChannelOwners;
+
+namespace {
+
+constexpr uint32_t kAshmem = static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM);
+constexpr uint32_t kGralloc = static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_GRALLOC);
+constexpr uint32_t kRates = static_cast<uint32_t>(SensorFlagBits::MASK_DIRECT_REPORT);
+constexpr uint32_t kWakeUp = static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
+
+struct Sensor {
+    size_t subHalIndex;
+    uint32_t flags;
+};
+
+}  // anonymous namespace
+
+TEST(DirectChannelOwnersTest, FirstSubHalOwnsEachMemoryType) {
+    DirectChannelOwners owners;
+    EXPECT_TRUE(owners.empty());
+
+    EXPECT_EQ(owners.claim(kRates | kAshmem, 0), kRates | kAshmem);
+    EXPECT_EQ(owners.claim(kRates | kAshmem | kGralloc, 1), kRates | kGralloc);
+    EXPECT_EQ(owners.claim(kRates | kAshmem | kGralloc, 0), kRates | kAshmem);
+
+    EXPECT_FALSE(owners.empty());
+    EXPECT_EQ(owners.owner(SharedMemType::ASHMEM), 0u);
+    EXPECT_EQ(owners.owner(SharedMemType::GRALLOC), 1u);
+}
+
+TEST(DirectChannelOwnersTest, SensorsLeftWithoutAMemoryTypeLoseTheirRates) {
+    DirectChannelOwners owners;
+
+    owners.claim(kRates | kAshmem, 0);
+    EXPECT_EQ(owners.claim(kWakeUp | kRates | kAshmem, 1), kWakeUp);
+    EXPECT_FALSE(owners.owner(SharedMemType::GRALLOC));
+}
+
+TEST(DirectChannelOwnersTest, SensorsWithoutDirectReportAreUntouched) {
+    DirectChannelOwners owners;
+
+    EXPECT_EQ(owners.claim(kWakeUp, 0), kWakeUp);
+    EXPECT_TRUE(owners.empty());
+}
+
+/*
+ * What a direct channel reader relies on: every sensor the framework may configure on a
+ * channel of some memory type belongs to the one subhal writing that channel.
+ */
+TEST(DirectChannelOwnersTest, EveryAdvertisedSensorBelongsToTheChannelWriter) {
+    const std::vector<Sensor> reported = {
+            {0, kRates | kGralloc}, {0, kWakeUp},           {1, kRates | kAshmem | kGralloc},
+            {1, kRates | kAshmem},  {2, kRates | kAshmem},  {2, kRates | kGralloc},
+            {0, kRates | kAshmem},  {2, kRates | kAshmem | kGralloc},
+    };
+
+    DirectChannelOwners owners;
+    std::vector<Sensor> advertised;
+    for (const Sensor& sensor : reported) {
+        advertised.push_back({sensor.subHalIndex, owners.claim(sensor.flags, sensor.subHalIndex)});
+    }
+
+    for (auto [memType, bit] : {std::pair{SharedMemType::ASHMEM, kAshmem},
+                                std::pair{SharedMemType::GRALLOC, kGralloc}}) {
+        auto writer = owners.owner(memType);
+        ASSERT_TRUE(writer);
+        for (const Sensor& sensor : advertised) {
+            if (sensor.flags & bit) {
+                EXPECT_EQ(sensor.subHalIndex, *writer);
+            }
+        }
+    }
+    EXPECT_EQ(owners.owner(SharedMemType::GRALLOC), 0u);
+    EXPECT_EQ(owners.owner(SharedMemType::ASHMEM), 1u);
+}
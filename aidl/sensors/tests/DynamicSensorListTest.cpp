@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DynamicSensorList.h"
+
+using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V2_1::SensorInfo;
+using ::android::hardware::sensors::V2_1::implementation::DynamicSensorList;
+
+namespace {
+
+constexpr int kReaders = 4;
+constexpr int kRounds = 2000;
+constexpr int32_t kSensors = 8;
+constexpr uint32_t kWakeUp = static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
+
+// Long enough that the name lives on the heap, where a dangling lookup would read freed memory
+std::string sensorName(int32_t sensorHandle) {
+    return "Dynamic sensor with a long enough name #" + std::to_string(sensorHandle);
+}
+
+SensorInfo makeSensor(int32_t sensorHandle) {
+    SensorInfo sensor = {};
+    sensor.sensorHandle = sensorHandle;
+    sensor.name = sensorName(sensorHandle);
+    sensor.flags = (sensorHandle % 2) ? kWakeUp : 0;
+    return sensor;
+}
+
+}  // anonymous namespace
+
+TEST(DynamicSensorListTest, AddFindRemove) {
+    DynamicSensorList sensors;
+
+    sensors.add(makeSensor(0x01000001));
+    ASSERT_TRUE(sensors.find(0x01000001));
+    EXPECT_EQ(sensors.find(0x01000001)->name, sensorName(0x01000001));
+    EXPECT_EQ(sensors.flags(0x01000001), kWakeUp);
+    EXPECT_EQ(sensors.handles(), std::vector<int32_t>({0x01000001}));
+
+    EXPECT_TRUE(sensors.remove(0x01000001));
+    EXPECT_FALSE(sensors.remove(0x01000001));
+    EXPECT_FALSE(sensors.find(0x01000001));
+    EXPECT_FALSE(sensors.flags(0x01000001));
+    EXPECT_EQ(sensors.size(), 0u);
+}
+
+/*
+ * Sensors connect and disconnect while other threads look them up, like subhals posting events
+ * during dynamic sensor churn. Every lookup sees either nothing or a whole sensor.
+ */
+TEST(DynamicSensorListTest, LookupsDuringChurn) {
+    DynamicSensorList sensors;
+    std::atomic<bool> done = false;
+    std::atomic<int> failures = 0;
+    std::atomic<uint64_t> hits = 0;
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < kReaders; r++) {
+        readers.emplace_back([&, r] {
+            for (int32_t i = r; !done; i++) {
+                const int32_t sensorHandle = 0x01000000 | (i % kSensors);
+                std::optional<SensorInfo> sensor = sensors.find(sensorHandle);
+                if (sensor) {
+                    hits++;
+                    if (sensor->sensorHandle != sensorHandle ||
+                        sensor->name != sensorName(sensorHandle) ||
+                        sensor->flags != makeSensor(sensorHandle).flags) {
+                        failures++;
+                    }
+                }
+                std::optional<uint32_t> flags = sensors.flags(sensorHandle);
+                if (flags && *flags != makeSensor(sensorHandle).flags) {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (int round = 0; round < kRounds; round++) {
+        for (int32_t s = 0; s < kSensors; s++) {
+            sensors.add(makeSensor(0x01000000 | s));
+        }
+        // Re-initialization drops all of them at once
+        if (round % 100 == 0) {
+            sensors.clear();
+            continue;
+        }
+        for (int32_t sensorHandle : sensors.handles()) {
+            if (!sensors.remove(sensorHandle)) {
+                failures++;
+            }
+        }
+    }
+    done = true;
+
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(failures, 0);
+    EXPECT_EQ(sensors.size(), 0u);
+    RecordProperty("hits", std::to_string(hits.load()));
+}
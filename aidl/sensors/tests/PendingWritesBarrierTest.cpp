@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "DynamicSensorList.h"
+#include "PendingWritesBarrier.h"
+
+using ::android::hardware::sensors::V2_1::SensorInfo;
+using ::android::hardware::sensors::V2_1::implementation::DynamicSensorList;
+using ::android::hardware::sensors::V2_1::implementation::PendingWritesBarrier;
+
+namespace {
+
+constexpr auto kTimeout = std::chrono::seconds(5);
+constexpr int kSubHals = 4;
+constexpr int kRounds = 500;
+constexpr int kBatchesPerSensor = 3;
+
+/*
+ * The parts of HalProxy a dynamic sensor disconnect races with: the pending write events queue,
+ * drained by a writer thread that looks up every event's sensor, and the dynamic sensor list.
+ */
+class FakeProxy {
+  public:
+    FakeProxy() : mWriter([this] { writePending(); }) {}
+
+    ~FakeProxy() {
+        mRun = false;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mBarrier.wake();
+        }
+        mWriteCV.notify_one();
+        mWriter.join();
+    }
+
+    void connect(int32_t sensorHandle) {
+        SensorInfo sensor = {};
+        sensor.sensorHandle = sensorHandle;
+        mSensors.add(sensor);
+    }
+
+    // Events that didn't fit the FMQ and wait for the writer
+    void post(std::vector<int32_t> sensorHandles) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPending.push(std::move(sensorHandles));
+        mBarrier.enqueued();
+        mWriteCV.notify_one();
+    }
+
+    // What onDynamicSensorsDisconnected does
+    bool disconnect(int32_t sensorHandle) {
+        bool done;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            done = mBarrier.wait(lock, kTimeout, [&] { return !mRun.load(); });
+        }
+        mSensors.remove(sensorHandle);
+        return done;
+    }
+
+    int unknownHandles() const { return mUnknownHandles; }
+    int eventsWritten() const { return mEventsWritten; }
+
+    size_t waits() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mBarrier.waits();
+    }
+
+  private:
+    void writePending() {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (mRun) {
+            mWriteCV.wait(lock, [&] { return !mPending.empty() || !mRun.load(); });
+            if (!mRun) {
+                break;
+            }
+            // Only this thread pops, the front stays valid while unlocked
+            const std::vector<int32_t>& events = mPending.front();
+            lock.unlock();
+            for (int32_t sensorHandle : events) {
+                // Where HalProxy counts the wakeup events of a batch
+                if (!mSensors.flags(sensorHandle)) {
+                    mUnknownHandles++;
+                }
+                mEventsWritten++;
+            }
+            // A slow reader on the other end of the FMQ, so entries pile up
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+            lock.lock();
+            mPending.pop();
+            mBarrier.done();
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mWriteCV;
+    std::queue<std::vector<int32_t>> mPending;
+    PendingWritesBarrier mBarrier;
+    DynamicSensorList mSensors;
+    std::atomic<bool> mRun = true;
+    std::atomic<int> mUnknownHandles = 0;
+    std::atomic<int> mEventsWritten = 0;
+    std::thread mWriter;
+};
+
+}  // anonymous namespace
+
+/*
+ * Subhals connect sensors, post events for them that end up on the pending queue and disconnect
+ * them again right away. The writer never looks up a sensor that is already gone.
+ */
+TEST(PendingWritesBarrierTest, ChurnNeverWritesUnknownHandles) {
+    FakeProxy proxy;
+
+    std::vector<std::thread> subHals;
+    std::atomic<int> timeouts = 0;
+    for (int subHal = 0; subHal < kSubHals; subHal++) {
+        subHals.emplace_back([&, subHal] {
+            for (int round = 0; round < kRounds; round++) {
+                int32_t sensorHandle = ((subHal + 1) << 24) | round;
+                proxy.connect(sensorHandle);
+                for (int batch = 0; batch < kBatchesPerSensor; batch++) {
+                    proxy.post({sensorHandle, sensorHandle});
+                }
+                if (!proxy.disconnect(sensorHandle)) {
+                    timeouts++;
+                }
+            }
+        });
+    }
+    for (auto& subHal : subHals) {
+        subHal.join();
+    }
+
+    EXPECT_EQ(timeouts, 0);
+    EXPECT_EQ(proxy.unknownHandles(), 0);
+    EXPECT_EQ(proxy.eventsWritten(), kSubHals * kRounds * kBatchesPerSensor * 2);
+    // The disconnects did have writes to wait for
+    EXPECT_GT(proxy.waits(), 0u);
+}
+
+TEST(PendingWritesBarrierTest, LaterEntriesDontExtendTheWait) {
+    std::mutex lock;
+    PendingWritesBarrier barrier;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        barrier.enqueued();
+    }
+
+    // The predicate first runs once the waiter took its barrier
+    std::condition_variable waitingCV;
+    bool waiting = false;
+    auto waiter = std::async(std::launch::async, [&] {
+        std::unique_lock<std::mutex> guard(lock);
+        return barrier.wait(guard, kTimeout, [&] {
+            waiting = true;
+            waitingCV.notify_all();
+            return false;
+        });
+    });
+
+    // Queued behind the barrier and never written
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        ASSERT_TRUE(waitingCV.wait_for(guard, kTimeout, [&] { return waiting; }));
+        barrier.enqueued();
+        barrier.enqueued();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        barrier.done();
+    }
+
+    ASSERT_EQ(waiter.wait_for(kTimeout), std::future_status::ready);
+    EXPECT_TRUE(waiter.get());
+    std::lock_guard<std::mutex> guard(lock);
+    EXPECT_EQ(barrier.outstanding(), 2u);
+    EXPECT_EQ(barrier.timeouts(), 0u);
+}
+
+TEST(PendingWritesBarrierTest, ResetAndStopReleaseWaiters) {
+    std::mutex lock;
+    PendingWritesBarrier barrier;
+    bool stopped = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        barrier.enqueued();
+    }
+
+    // A cleared queue counts as written
+    auto resetWaiter = std::async(std::launch::async, [&] {
+        std::unique_lock<std::mutex> guard(lock);
+        return barrier.wait(guard, kTimeout, [&] { return stopped; });
+    });
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        barrier.reset();
+    }
+    ASSERT_EQ(resetWaiter.wait_for(kTimeout), std::future_status::ready);
+    EXPECT_TRUE(resetWaiter.get());
+
+    // Stopping the threads ends the wait even though nothing will be written any more
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        barrier.enqueued();
+    }
+    auto stopWaiter = std::async(std::launch::async, [&] {
+        std::unique_lock<std::mutex> guard(lock);
+        return barrier.wait(guard, kTimeout, [&] { return stopped; });
+    });
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopped = true;
+        barrier.wake();
+    }
+    ASSERT_EQ(stopWaiter.wait_for(kTimeout), std::future_status::ready);
+    EXPECT_TRUE(stopWaiter.get());
+}
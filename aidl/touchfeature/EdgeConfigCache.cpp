@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "TouchFeature"
+
+#include "EdgeConfigCache.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hw {
+namespace touchfeature {
+
+namespace {
+
+uint64_t hashValues(const std::vector<int32_t>& values) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int32_t value : values) {
+        hash ^= static_cast<uint32_t>(value);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+}  // anonymous namespace
+
+bool makeEdgeConfig(int32_t touchId, int32_t mode, const std::vector<int32_t>& value,
+                    int32_t length, EdgeConfig* config) {
+    if (length < 0 || length > static_cast<int32_t>(value.size()) || length > kMaxEdgeValues) {
+        LOG(ERROR) << "Invalid edge mode length " << length;
+        return false;
+    }
+
+    config->touchId = touchId;
+    config->mode = mode;
+    config->values.assign(value.begin(), value.begin() + length);
+    config->hash = hashValues(config->values);
+
+    config->packed.fill(0);
+    config->packed[0] = touchId;
+    config->packed[1] = mode;
+    config->packed[2] = length;
+    std::copy(config->values.begin(), config->values.end(), config->packed.begin() + 3);
+
+    return true;
+}
+
+bool EdgeConfigCache::contains(const EdgeConfig& config) const {
+    auto it = mConfigs.find({config.touchId, config.mode});
+    return it != mConfigs.end() && it->second->sameValues(config);
+}
+
+void EdgeConfigCache::accepted(std::shared_ptr<const EdgeConfig> config) {
+    mConfigs[{config->touchId, config->mode}] = std::move(config);
+}
+
+void EdgeConfigCache::forget(int32_t touchId, int32_t mode) {
+    mConfigs.erase({touchId, mode});
+}
+
+void EdgeConfigCache::dump(std::ostream& stream) const {
+    stream << "  Edge configurations: " << mConfigs.size() << std::endl;
+    for (const auto& [key, config] : mConfigs) {
+        stream << "    touchId " << key.first << " mode " << key.second << ": "
+               << config->values.size() << " values, hash " << std::hex << config->hash
+               << std::dec << std::endl;
+    }
+}
+
+}  // namespace touchfeature
+}  // namespace hw
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
@@ -0,0 +1,70 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "xiaomi_touch.h"
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hw {
+namespace touchfeature {
+
+// setEdgeMode values are opaque to the HAL, their layout is up to the driver
+constexpr int32_t kMaxEdgeValues = TOUCH_BUF_SIZE - 3;
+
+struct EdgeConfig {
+    int32_t touchId;
+    int32_t mode;
+    std::vector<int32_t> values;
+    uint64_t hash;
+    // Ready to be handed to TOUCH_IOC_SET_LONG_VALUE as is
+    std::array<int32_t, TOUCH_BUF_SIZE> packed;
+
+    bool sameValues(const EdgeConfig& other) const {
+        return hash == other.hash && values == other.values;
+    }
+};
+
+/*
+ * Builds the driver buffer for the first length values of a setEdgeMode call, along with the
+ * hash EdgeConfigCache matches it by.
+ */
+bool makeEdgeConfig(int32_t touchId, int32_t mode, const std::vector<int32_t>& value,
+                    int32_t length, EdgeConfig* config);
+
+/*
+ * The last edge configuration the driver accepted per mode, so that setEdgeMode calls repeating
+ * it can be dropped. Not thread safe.
+ */
+class EdgeConfigCache {
+  public:
+    //! Whether the driver already has this configuration.
+    bool contains(const EdgeConfig& config) const;
+    //! Remember a configuration the driver accepted.
+    void accepted(std::shared_ptr<const EdgeConfig> config);
+    //! Forget a mode whose driver state is unknown, so the next call is written again.
+    void forget(int32_t touchId, int32_t mode);
+
+    void dump(std::ostream& stream) const;
+
+  private:
+    std::map<std::pair<int32_t, int32_t>, std::shared_ptr<const EdgeConfig>> mConfigs;
+};
+
+}  // namespace touchfeature
+}  // namespace hw
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
@@ -0,0 +1,657 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "TouchFeature"
+
+#include "TouchFeature.h"
+#include "xiaomi_touch.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <optional>
+#include <sstream>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hw {
+namespace touchfeature {
+
+namespace {
+
+// Bursts of setTouchMode are written out at most once per frame (120 Hz)
+constexpr auto kFlushInterval = microseconds(8333);
+
+constexpr size_t kMaxProfiles = 64;
+constexpr size_t kMaxAppProfiles = 256;
+
+}  // anonymous namespace
+
+TouchFeature::TouchFeature() {
+    mFd.reset(TEMP_FAILURE_RETRY(open(TOUCH_DEV_PATH, O_RDWR | O_CLOEXEC)));
+    if (!mFd.ok()) {
+        PLOG(ERROR) << "Failed to open " << TOUCH_DEV_PATH;
+    }
+
+    mFlushThread = std::thread(&TouchFeature::flushThread, this);
+}
+
+TouchFeature::~TouchFeature() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCv.notify_all();
+    mFlushThread.join();
+}
+
+bool TouchFeature::touchIoctl(unsigned long cmd, int32_t* buf) {
+    if (!mFd.ok()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mIoctlLock);
+    if (ioctl(mFd.get(), cmd, buf) < 0) {
+        PLOG(ERROR) << "Touch ioctl " << _IOC_NR(cmd) << " failed for touchId " << buf[0]
+                    << ", mode " << buf[1];
+        return false;
+    }
+
+    return true;
+}
+
+bool TouchFeature::writeEdgeConfig(const EdgeConfig& config) {
+    // TOUCH_IOC_SET_LONG_VALUE only reads the buffer, so the cached one is passed as is
+    return touchIoctl(TOUCH_IOC_SET_LONG_VALUE, const_cast<int32_t*>(config.packed.data()));
+}
+
+bool TouchFeature::queryMode(int32_t touchId, int32_t mode, ModeState* state) {
+    const struct {
+        unsigned long cmd;
+        int32_t* out;
+    } queries[] = {
+            {TOUCH_IOC_GET_CUR_VALUE, &state->cur},
+            {TOUCH_IOC_GET_DEF_VALUE, &state->def},
+            {TOUCH_IOC_GET_MIN_VALUE, &state->min},
+            {TOUCH_IOC_GET_MAX_VALUE, &state->max},
+    };
+
+    for (const auto& query : queries) {
+        int32_t buf[TOUCH_BUF_SIZE] = {touchId, mode};
+        if (!touchIoctl(query.cmd, buf)) {
+            return false;
+        }
+        *query.out = buf[0];
+    }
+    state->written = state->cur;
+
+    return true;
+}
+
+/*
+ * Modes are read from the driver the first time they are asked for, every later get is served
+ * from mModes.
+ */
+::ndk::ScopedAStatus TouchFeature::getModeState(int32_t touchId, int32_t mode, ModeState* state) {
+    if (touchId < 0 || mode < 0) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    const ModeKey key(touchId, mode);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mModes.find(key);
+        if (it != mModes.end()) {
+            *state = it->second;
+            return ::ndk::ScopedAStatus::ok();
+        }
+    }
+
+    ModeState queried;
+    if (!queryMode(touchId, mode, &queried)) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    // A write queued while querying is newer than what the driver reported
+    auto pending = mPending.find(key);
+    if (pending != mPending.end()) {
+        queried.cur = pending->second;
+    }
+    *state = mModes.emplace(key, queried).first->second;
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus TouchFeature::getModeCurValueString(int32_t touchId, int32_t mode,
+                                                         int32_t* _aidl_return) {
+    return getTouchModeCurValue(touchId, mode, _aidl_return);
+}
+
+::ndk::ScopedAStatus TouchFeature::getModeValues(int32_t touchId, int32_t mode,
+                                                 int32_t* _aidl_return) {
+    return getTouchModeCurValue(touchId, mode, _aidl_return);
+}
+
+::ndk::ScopedAStatus TouchFeature::getTouchModeCurValue(int32_t touchId, int32_t mode,
+                                                        int32_t* _aidl_return) {
+    ModeState state;
+    auto status = getModeState(touchId, mode, &state);
+    if (status.isOk()) {
+        *_aidl_return = state.cur;
+    }
+    return status;
+}
+
+::ndk::ScopedAStatus TouchFeature::getTouchModeDefValue(int32_t touchId, int32_t mode,
+                                                        int32_t* _aidl_return) {
+    ModeState state;
+    auto status = getModeState(touchId, mode, &state);
+    if (status.isOk()) {
+        *_aidl_return = state.def;
+    }
+    return status;
+}
+
+::ndk::ScopedAStatus TouchFeature::getTouchModeMaxValue(int32_t touchId, int32_t mode,
+                                                        int32_t* _aidl_return) {
+    ModeState state;
+    auto status = getModeState(touchId, mode, &state);
+    if (status.isOk()) {
+        *_aidl_return = state.max;
+    }
+    return status;
+}
+
+::ndk::ScopedAStatus TouchFeature::getTouchModeMinValue(int32_t touchId, int32_t mode,
+                                                        int32_t* _aidl_return) {
+    ModeState state;
+    auto status = getModeState(touchId, mode, &state);
+    if (status.isOk()) {
+        *_aidl_return = state.min;
+    }
+    return status;
+}
+
+::ndk::ScopedAStatus TouchFeature::resetTouchMode(int32_t touchId, int32_t mode,
+                                                  bool* _aidl_return) {
+    if (touchId < 0 || mode < 0) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    const ModeKey key(touchId, mode);
+    std::unique_lock<std::mutex> lock(mLock);
+    // A reset supersedes anything still queued for this mode
+    discardPendingLocked(lock, {key});
+    lock.unlock();
+
+    int32_t buf[TOUCH_BUF_SIZE] = {touchId, mode};
+    *_aidl_return = touchIoctl(TOUCH_IOC_RESET_MODE, buf);
+
+    lock.lock();
+    auto it = mModes.find(key);
+    if (it != mModes.end()) {
+        if (*_aidl_return) {
+            it->second.written = it->second.def;
+            if (!mPending.count(key)) {
+                it->second.cur = it->second.def;
+            }
+        } else {
+            // The driver state is unknown now, query it again on the next get
+            mModes.erase(it);
+        }
+    }
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+/*
+ * The values are passed to the driver untouched. Repeating the configuration the driver already
+ * has is a no-op.
+ */
+::ndk::ScopedAStatus TouchFeature::setEdgeMode(int32_t touchId, int32_t mode,
+                                               const std::vector<int32_t>& value, int32_t length,
+                                               bool* _aidl_return) {
+    if (touchId < 0 || mode < 0) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    auto config = std::make_shared<EdgeConfig>();
+    if (!makeEdgeConfig(touchId, mode, value, length, config.get())) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mEdgeConfigs.contains(*config)) {
+            mEdgeSuppressed++;
+            *_aidl_return = true;
+            return ::ndk::ScopedAStatus::ok();
+        }
+    }
+
+    *_aidl_return = writeEdgeConfig(*config);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mEdgeUpdates++;
+    if (*_aidl_return) {
+        mEdgeConfigs.accepted(std::move(config));
+    } else {
+        // The driver state is unknown now, don't suppress a retry
+        mEdgeConfigs.forget(touchId, mode);
+    }
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+/*
+ * Only updates the cache and queues the value, flushThread() takes it to the driver.
+ */
+::ndk::ScopedAStatus TouchFeature::setTouchMode(int32_t touchId, int32_t mode, int32_t value) {
+    if (touchId < 0 || mode < 0) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    const auto start = steady_clock::now();
+    const ModeKey key(touchId, mode);
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mSetCalls++;
+
+        auto it = mModes.find(key);
+        if (it != mModes.end() && it->second.cur == value && !mPending.count(key)) {
+            mSetSuppressed++;
+        } else {
+            if (it != mModes.end()) {
+                it->second.cur = value;
+            }
+            if (mPending.empty()) {
+                mPendingSince = start;
+                wake = true;
+            }
+            mPending[key] = value;
+        }
+
+        auto elapsed = steady_clock::now() - start;
+        mTotalSetTime += elapsed;
+        mMaxSetTime = std::max<std::chrono::nanoseconds>(mMaxSetTime, elapsed);
+    }
+
+    if (wake) {
+        mCv.notify_one();
+    }
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+/*
+ * The first write after an idle period goes out right away, anything arriving within the same
+ * frame is held back and only the latest value per mode is written at the next frame boundary.
+ */
+void TouchFeature::flushThread() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (true) {
+        mCv.wait(lock, [this] { return mExit || !mPending.empty(); });
+        if (mExit) {
+            return;
+        }
+
+        auto deadline = mLastFlushTime + kFlushInterval;
+        if (mCv.wait_until(lock, deadline, [this] { return mExit; })) {
+            return;
+        }
+
+        std::map<ModeKey, int32_t> pending;
+        pending.swap(mPending);
+        auto pendingSince = mPendingSince;
+        mFlushing = true;
+
+        lock.unlock();
+        std::vector<ModeKey> failed;
+        for (const auto& [key, value] : pending) {
+            int32_t buf[TOUCH_BUF_SIZE] = {key.first, key.second, value};
+            if (!touchIoctl(TOUCH_IOC_SET_CUR_VALUE, buf)) {
+                failed.push_back(key);
+            }
+        }
+        auto now = steady_clock::now();
+        lock.lock();
+
+        for (const auto& [key, value] : pending) {
+            auto it = mModes.find(key);
+            if (it == mModes.end()) {
+                continue;
+            }
+            if (std::find(failed.begin(), failed.end(), key) == failed.end()) {
+                it->second.written = value;
+            } else {
+                // The driver state is unknown now, query it again on the next get
+                mModes.erase(it);
+            }
+        }
+        mFlushing = false;
+        mFlushedCv.notify_all();
+
+        mLastFlushTime = now;
+        mFlushes++;
+        mWrites += pending.size();
+        mWriteFailures += failed.size();
+        auto latency = now - pendingSince;
+        mTotalFlushLatency += latency;
+        mMaxFlushLatency = std::max<std::chrono::nanoseconds>(mMaxFlushLatency, latency);
+    }
+}
+
+::ndk::ScopedAStatus TouchFeature::setProfile(
+        const std::string& name,
+        const ::aidl::vendor::xiaomi::hardware::touchfeature::TouchProfile& profile) {
+    const std::pair<int32_t, int32_t> fields[] = {
+            {Touch_Report_Rate, profile.reportRate},
+            {Touch_UP_THRESHOLD, profile.sensitivity},
+            {Touch_Edge_Filter, profile.edgeFilter},
+            {Touch_Tolerance, profile.smoothing},
+            {Touch_Tap_Stability, profile.tapStability},
+    };
+
+    if (name.empty() || profile.touchId < 0) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    ModeWrites writes = {{{profile.touchId, Touch_Game_Mode}, 1}};
+    for (const auto& [mode, value] : fields) {
+        if (value < -1) {
+            return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+        }
+        if (value != -1) {
+            writes.push_back({{profile.touchId, mode}, value});
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mProfileLock);
+    if (!mProfiles.count(name) && mProfiles.size() >= kMaxProfiles) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+    mProfiles[name] = std::move(writes);
+
+    if (name == mActiveProfile) {
+        applyProfileLocked(name);
+    }
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus TouchFeature::removeProfile(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mProfileLock);
+    if (!mProfiles.erase(name)) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    if (name == mActiveProfile) {
+        applyProfileLocked("");
+    }
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus TouchFeature::setAppProfile(const std::string& packageName,
+                                                 const std::string& profileName) {
+    if (packageName.empty()) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    std::lock_guard<std::mutex> lock(mProfileLock);
+    if (profileName.empty()) {
+        mAppProfiles.erase(packageName);
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    if (!mAppProfiles.count(packageName) && mAppProfiles.size() >= kMaxAppProfiles) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+    mAppProfiles[packageName] = profileName;
+
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus TouchFeature::applyProfile(const std::string& name, bool* _aidl_return) {
+    std::lock_guard<std::mutex> lock(mProfileLock);
+    if (!name.empty() && !mProfiles.count(name)) {
+        return ::ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    *_aidl_return = applyProfileLocked(name);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+::ndk::ScopedAStatus TouchFeature::onForegroundAppChanged(const std::string& packageName,
+                                                          bool* _aidl_return) {
+    std::lock_guard<std::mutex> lock(mProfileLock);
+
+    std::string name;
+    auto it = mAppProfiles.find(packageName);
+    // Assignments to profiles that were removed since fall back to the defaults
+    if (it != mAppProfiles.end() && mProfiles.count(it->second)) {
+        name = it->second;
+    }
+
+    *_aidl_return = name == mActiveProfile || applyProfileLocked(name);
+    return ::ndk::ScopedAStatus::ok();
+}
+
+/*
+ * Writes every mode of the profile back to back from the calling thread, without going through
+ * the frame coalescing of setTouchMode. Modes only the outgoing profile set are reset to their
+ * defaults in the same transaction.
+ */
+bool TouchFeature::applyProfileLocked(const std::string& name) {
+    const auto start = steady_clock::now();
+
+    ModeWrites writes;
+    if (!name.empty()) {
+        writes = mProfiles.at(name);
+    }
+
+    // Every mode is read from the driver once before the transaction touches it
+    for (const auto& [key, value] : writes) {
+        ModeState state;
+        if (!getModeState(key.first, key.second, &state).isOk()) {
+            return false;
+        }
+    }
+    for (const auto& [key, value] : mActiveWrites) {
+        bool kept = std::any_of(writes.begin(), writes.end(),
+                                [&key](const auto& write) { return write.first == key; });
+        if (kept) {
+            continue;
+        }
+
+        ModeState state;
+        if (!getModeState(key.first, key.second, &state).isOk()) {
+            return false;
+        }
+        writes.push_back({key, state.def});
+    }
+
+    bool applied = applyModeWrites(writes);
+    if (applied) {
+        mActiveProfile = name;
+        mActiveWrites = mProfiles.count(name) ? mProfiles.at(name) : ModeWrites();
+    } else {
+        mProfileRollbacks++;
+    }
+
+    auto elapsed = steady_clock::now() - start;
+    mProfileApplies++;
+    if (elapsed <= kFlushInterval) {
+        mProfileAppliesInFrame++;
+    }
+    mTotalApplyTime += elapsed;
+    mMaxApplyTime = std::max<std::chrono::nanoseconds>(mMaxApplyTime, elapsed);
+    mLastApplyTime = elapsed;
+
+    return applied;
+}
+
+/*
+ * Drops the queued values of the given modes. A flush still writing values it already took out
+ * of mPending is waited for, so none of them can land after the caller's own write.
+ */
+void TouchFeature::discardPendingLocked(std::unique_lock<std::mutex>& lock,
+                                        const std::vector<ModeKey>& keys) {
+    mFlushedCv.wait(lock, [this] { return !mFlushing; });
+    for (const auto& key : keys) {
+        mPending.erase(key);
+    }
+}
+
+/*
+ * All or nothing: if a write fails, the modes written so far are restored to their previous
+ * values in reverse order. Writes are skipped for modes the driver already has at the value,
+ * going by what it last accepted rather than by what is cached for getTouchModeCurValue.
+ */
+bool TouchFeature::applyModeWrites(const ModeWrites& writes) {
+    std::vector<ModeKey> keys;
+    keys.reserve(writes.size());
+    for (const auto& [key, value] : writes) {
+        keys.push_back(key);
+    }
+
+    // The driver value of each mode, if known
+    std::vector<std::optional<int32_t>> previous;
+    previous.reserve(writes.size());
+    {
+        // The transaction supersedes anything still queued for these modes
+        std::unique_lock<std::mutex> lock(mLock);
+        discardPendingLocked(lock, keys);
+        for (const auto& key : keys) {
+            auto it = mModes.find(key);
+            previous.push_back(it != mModes.end() ? std::optional<int32_t>(it->second.written)
+                                                  : std::nullopt);
+        }
+    }
+
+    size_t written = 0;
+    for (; written < writes.size(); written++) {
+        const auto& [key, value] = writes[written];
+        if (previous[written] == value) {
+            continue;
+        }
+
+        int32_t buf[TOUCH_BUF_SIZE] = {key.first, key.second, value};
+        if (!touchIoctl(TOUCH_IOC_SET_CUR_VALUE, buf)) {
+            break;
+        }
+    }
+
+    const bool applied = written == writes.size();
+    std::vector<ModeKey> unknown;
+    if (!applied) {
+        // The failed mode itself may or may not have been changed by the driver
+        unknown.push_back(keys[written]);
+
+        while (written-- > 0) {
+            const auto& key = keys[written];
+            if (!previous[written]) {
+                unknown.push_back(key);
+                continue;
+            }
+            if (*previous[written] == writes[written].second) {
+                continue;
+            }
+
+            int32_t buf[TOUCH_BUF_SIZE] = {key.first, key.second, *previous[written]};
+            if (!touchIoctl(TOUCH_IOC_SET_CUR_VALUE, buf)) {
+                unknown.push_back(key);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    for (const auto& [key, value] : writes) {
+        auto it = mModes.find(key);
+        if (it == mModes.end()) {
+            continue;
+        }
+        if (applied) {
+            it->second.written = value;
+        }
+        // A setTouchMode queued during the transaction is still reported until it is flushed
+        if (!mPending.count(key)) {
+            it->second.cur = it->second.written;
+        }
+    }
+    for (const auto& key : unknown) {
+        mModes.erase(key);
+    }
+
+    return applied;
+}
+
+binder_status_t TouchFeature::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    std::lock_guard<std::mutex> profileLock(mProfileLock);
+    std::lock_guard<std::mutex> lock(mLock);
+
+    std::ostringstream stream;
+    stream << "TouchFeature:" << std::endl;
+    stream << "  Device: " << (mFd.ok() ? "open" : "unavailable") << std::endl;
+    stream << "  Cached modes: " << mModes.size() << ", pending writes: " << mPending.size()
+           << std::endl;
+    for (const auto& [key, state] : mModes) {
+        stream << "    touchId " << key.first << " mode " << key.second << ": cur " << state.cur
+               << ", def " << state.def << ", min " << state.min << ", max " << state.max
+               << std::endl;
+    }
+    mEdgeConfigs.dump(stream);
+    stream << "  setEdgeMode updates: " << mEdgeUpdates << ", suppressed: " << mEdgeSuppressed
+           << std::endl;
+    stream << "  setTouchMode calls: " << mSetCalls << ", suppressed: " << mSetSuppressed
+           << std::endl;
+    stream << "  Flushes: " << mFlushes << ", writes: " << mWrites
+           << ", failed: " << mWriteFailures << std::endl;
+
+    if (mSetCalls > 0) {
+        stream << "  Set latency avg: "
+               << duration_cast<std::chrono::nanoseconds>(mTotalSetTime / mSetCalls).count()
+               << " ns, max: " << mMaxSetTime.count() << " ns" << std::endl;
+    }
+
+    if (mFlushes > 0) {
+        stream << "  Set to driver latency avg: "
+               << duration_cast<microseconds>(mTotalFlushLatency / mFlushes).count()
+               << " us, max: " << duration_cast<microseconds>(mMaxFlushLatency).count() << " us"
+               << std::endl;
+    }
+
+    stream << "  Profiles: " << mProfiles.size() << ", app assignments: " << mAppProfiles.size()
+           << ", active: " << (mActiveProfile.empty() ? "(defaults)" : mActiveProfile)
+           << std::endl;
+    stream << "  Profile applies: " << mProfileApplies << ", within a frame: "
+           << mProfileAppliesInFrame << ", rolled back: " << mProfileRollbacks << std::endl;
+
+    if (mProfileApplies > 0) {
+        stream << "  Profile apply latency avg: "
+               << duration_cast<microseconds>(mTotalApplyTime / mProfileApplies).count()
+               << " us, max: " << duration_cast<microseconds>(mMaxApplyTime).count()
+               << " us, last: " << duration_cast<microseconds>(mLastApplyTime).count() << " us"
+               << std::endl;
+    }
+
+    ::android::base::WriteStringToFd(stream.str(), fd);
+    return STATUS_OK;
+}
+
+}  // namespace touchfeature
+}  // namespace hw
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
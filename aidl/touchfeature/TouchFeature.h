@@ -0,0 +1,146 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "EdgeConfigCache.h"
+
+#include <aidl/vendor/xiaomi/hardware/touchfeature/TouchProfile.h>
+#include <aidl/vendor/xiaomi/hw/touchfeature/BnTouchFeature.h>
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hw {
+namespace touchfeature {
+
+class TouchFeature : public BnTouchFeature {
+  public:
+    TouchFeature();
+    ~TouchFeature();
+
+    ::ndk::ScopedAStatus getModeCurValueString(int32_t touchId, int32_t mode,
+                                               int32_t* _aidl_return) override;
+    ::ndk::ScopedAStatus getModeValues(int32_t touchId, int32_t mode,
+                                       int32_t* _aidl_return) override;
+    ::ndk::ScopedAStatus getTouchModeCurValue(int32_t touchId, int32_t mode,
+                                              int32_t* _aidl_return) override;
+    ::ndk::ScopedAStatus getTouchModeDefValue(int32_t touchId, int32_t mode,
+                                              int32_t* _aidl_return) override;
+    ::ndk::ScopedAStatus getTouchModeMaxValue(int32_t touchId, int32_t mode,
+                                              int32_t* _aidl_return) override;
+    ::ndk::ScopedAStatus getTouchModeMinValue(int32_t touchId, int32_t mode,
+                                              int32_t* _aidl_return) override;
+    ::ndk::ScopedAStatus resetTouchMode(int32_t touchId, int32_t mode,
+                                        bool* _aidl_return) override;
+    ::ndk::ScopedAStatus setEdgeMode(int32_t touchId, int32_t mode,
+                                     const std::vector<int32_t>& value, int32_t length,
+                                     bool* _aidl_return) override;
+    ::ndk::ScopedAStatus setTouchMode(int32_t touchId, int32_t mode, int32_t value) override;
+
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
+    // Backing for vendor.xiaomi.hardware.touchfeature.ITouchFeatureExt
+    ::ndk::ScopedAStatus setProfile(
+            const std::string& name,
+            const ::aidl::vendor::xiaomi::hardware::touchfeature::TouchProfile& profile);
+    ::ndk::ScopedAStatus removeProfile(const std::string& name);
+    ::ndk::ScopedAStatus setAppProfile(const std::string& packageName,
+                                       const std::string& profileName);
+    ::ndk::ScopedAStatus applyProfile(const std::string& name, bool* _aidl_return);
+    ::ndk::ScopedAStatus onForegroundAppChanged(const std::string& packageName,
+                                                bool* _aidl_return);
+
+  private:
+    using ModeKey = std::pair<int32_t, int32_t>;
+    using ModeWrites = std::vector<std::pair<ModeKey, int32_t>>;
+
+    struct ModeState {
+        // What getTouchModeCurValue reports, pending writes included
+        int32_t cur;
+        // The value the driver last reported or accepted
+        int32_t written;
+        int32_t def;
+        int32_t min;
+        int32_t max;
+    };
+
+    bool touchIoctl(unsigned long cmd, int32_t* buf);
+    bool writeEdgeConfig(const EdgeConfig& config);
+    bool queryMode(int32_t touchId, int32_t mode, ModeState* state);
+    ::ndk::ScopedAStatus getModeState(int32_t touchId, int32_t mode, ModeState* state);
+    void flushThread();
+    bool applyProfileLocked(const std::string& name);
+    void discardPendingLocked(std::unique_lock<std::mutex>& lock,
+                              const std::vector<ModeKey>& keys);
+    bool applyModeWrites(const ModeWrites& writes);
+
+    ::android::base::unique_fd mFd;
+    // Serializes driver access between binder threads and the flush thread
+    std::mutex mIoctlLock;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    // Signaled when mFlushing goes back to false
+    std::condition_variable mFlushedCv;
+    // State of every mode seen so far
+    std::map<ModeKey, ModeState> mModes;
+    // Latest value per mode not yet written to the driver
+    std::map<ModeKey, int32_t> mPending;
+    // Last setEdgeMode values the driver accepted, to skip writing them again
+    EdgeConfigCache mEdgeConfigs;
+    std::chrono::steady_clock::time_point mPendingSince;
+    std::chrono::steady_clock::time_point mLastFlushTime;
+    // Set while the flush thread writes values it took out of mPending
+    bool mFlushing = false;
+    bool mExit = false;
+
+    // Statistics, guarded by mLock
+    uint64_t mSetCalls = 0;
+    uint64_t mSetSuppressed = 0;
+    uint64_t mFlushes = 0;
+    uint64_t mWrites = 0;
+    uint64_t mWriteFailures = 0;
+    uint64_t mEdgeUpdates = 0;
+    uint64_t mEdgeSuppressed = 0;
+    std::chrono::nanoseconds mTotalSetTime{0};
+    std::chrono::nanoseconds mMaxSetTime{0};
+    std::chrono::nanoseconds mTotalFlushLatency{0};
+    std::chrono::nanoseconds mMaxFlushLatency{0};
+
+    // Profiles are kept compiled to the mode writes they make. Lock before mLock.
+    std::mutex mProfileLock;
+    std::unordered_map<std::string, ModeWrites> mProfiles;
+    std::unordered_map<std::string, std::string> mAppProfiles;
+    std::string mActiveProfile;
+    ModeWrites mActiveWrites;
+
+    // Profile statistics, guarded by mProfileLock
+    uint64_t mProfileApplies = 0;
+    uint64_t mProfileAppliesInFrame = 0;
+    uint64_t mProfileRollbacks = 0;
+    std::chrono::nanoseconds mTotalApplyTime{0};
+    std::chrono::nanoseconds mMaxApplyTime{0};
+    std::chrono::nanoseconds mLastApplyTime{0};
+
+    std::thread mFlushThread;
+};
+
+}  // namespace touchfeature
+}  // namespace hw
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
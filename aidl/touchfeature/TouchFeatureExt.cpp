@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "TouchFeatureExt.h"
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace touchfeature {
+
+TouchFeatureExt::TouchFeatureExt(
+        std::shared_ptr<::aidl::vendor::xiaomi::hw::touchfeature::TouchFeature> touchFeature)
+    : mTouchFeature(std::move(touchFeature)) {}
+
+::ndk::ScopedAStatus TouchFeatureExt::setProfile(const std::string& name,
+                                                 const TouchProfile& profile) {
+    return mTouchFeature->setProfile(name, profile);
+}
+
+::ndk::ScopedAStatus TouchFeatureExt::removeProfile(const std::string& name) {
+    return mTouchFeature->removeProfile(name);
+}
+
+::ndk::ScopedAStatus TouchFeatureExt::setAppProfile(const std::string& packageName,
+                                                    const std::string& profileName) {
+    return mTouchFeature->setAppProfile(packageName, profileName);
+}
+
+::ndk::ScopedAStatus TouchFeatureExt::applyProfile(const std::string& name,
+                                                   bool* _aidl_return) {
+    return mTouchFeature->applyProfile(name, _aidl_return);
+}
+
+::ndk::ScopedAStatus TouchFeatureExt::onForegroundAppChanged(const std::string& packageName,
+                                                             bool* _aidl_return) {
+    return mTouchFeature->onForegroundAppChanged(packageName, _aidl_return);
+}
+
+}  // namespace touchfeature
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
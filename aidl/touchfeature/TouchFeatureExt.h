@@ -0,0 +1,40 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <aidl/vendor/xiaomi/hardware/touchfeature/BnTouchFeatureExt.h>
+
+#include "TouchFeature.h"
+
+namespace aidl {
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace touchfeature {
+
+class TouchFeatureExt : public BnTouchFeatureExt {
+  public:
+    TouchFeatureExt(std::shared_ptr<::aidl::vendor::xiaomi::hw::touchfeature::TouchFeature>
+                            touchFeature);
+
+    ::ndk::ScopedAStatus setProfile(const std::string& name,
+                                    const TouchProfile& profile) override;
+    ::ndk::ScopedAStatus removeProfile(const std::string& name) override;
+    ::ndk::ScopedAStatus setAppProfile(const std::string& packageName,
+                                       const std::string& profileName) override;
+    ::ndk::ScopedAStatus applyProfile(const std::string& name, bool* _aidl_return) override;
+    ::ndk::ScopedAStatus onForegroundAppChanged(const std::string& packageName,
+                                                bool* _aidl_return) override;
+
+  private:
+    std::shared_ptr<::aidl::vendor::xiaomi::hw::touchfeature::TouchFeature> mTouchFeature;
+};
+
+}  // namespace touchfeature
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
+}  // namespace aidl
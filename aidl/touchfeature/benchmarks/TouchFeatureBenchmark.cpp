@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <iterator>
+
+#include "TouchFeature.h"
+#include "xiaomi_touch.h"
+
+using ::aidl::vendor::xiaomi::hardware::touchfeature::TouchProfile;
+using ::aidl::vendor::xiaomi::hw::touchfeature::TouchFeature;
+
+namespace {
+
+constexpr int32_t kTouchId = 0;
+
+// The modes games retune while playing
+constexpr int32_t kGameModes[] = {
+        Touch_UP_THRESHOLD, Touch_Tolerance,   Touch_Aim_Sensitivity,
+        Touch_Tap_Stability, Touch_Edge_Filter, Touch_Report_Rate,
+};
+
+/*
+ * The service side of a setTouchMode call, binder excluded. Each iteration changes the value so
+ * nothing is suppressed, and the flush thread keeps writing to the driver in the background like
+ * it does on the device.
+ */
+void BM_SetTouchMode(benchmark::State& state) {
+    auto touchFeature = ::ndk::SharedRefBase::make<TouchFeature>();
+
+    int32_t value = 0;
+    for (auto _ : state) {
+        touchFeature->setTouchMode(kTouchId, Touch_UP_THRESHOLD, value);
+        value ^= 1;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SetTouchMode);
+
+// A game retuning every mode at once, all of which end up in the same flush
+void BM_SetTouchModeBurst(benchmark::State& state) {
+    auto touchFeature = ::ndk::SharedRefBase::make<TouchFeature>();
+
+    int32_t value = 0;
+    for (auto _ : state) {
+        for (int32_t mode : kGameModes) {
+            touchFeature->setTouchMode(kTouchId, mode, value);
+        }
+        value ^= 1;
+    }
+
+    state.SetItemsProcessed(state.iterations() * std::size(kGameModes));
+}
+BENCHMARK(BM_SetTouchModeBurst);
+
+// Setting the current value again, which never leaves the service
+void BM_SetTouchModeUnchanged(benchmark::State& state) {
+    auto touchFeature = ::ndk::SharedRefBase::make<TouchFeature>();
+
+    int32_t value;
+    if (!touchFeature->getTouchModeCurValue(kTouchId, Touch_UP_THRESHOLD, &value).isOk()) {
+        state.SkipWithError("touch device unavailable");
+        return;
+    }
+
+    for (auto _ : state) {
+        touchFeature->setTouchMode(kTouchId, Touch_UP_THRESHOLD, value);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SetTouchModeUnchanged);
+
+// Every get after the first is served from the cache
+void BM_GetTouchModeCurValue(benchmark::State& state) {
+    auto touchFeature = ::ndk::SharedRefBase::make<TouchFeature>();
+
+    int32_t value;
+    if (!touchFeature->getTouchModeCurValue(kTouchId, Touch_UP_THRESHOLD, &value).isOk()) {
+        state.SkipWithError("touch device unavailable");
+        return;
+    }
+
+    for (auto _ : state) {
+        touchFeature->getTouchModeCurValue(kTouchId, Touch_UP_THRESHOLD, &value);
+        benchmark::DoNotOptimize(value);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetTouchModeCurValue);
+
+/*
+ * Switching between two apps with their own profiles. Each switch is one transaction written
+ * from the calling thread, and has to land within a frame.
+ */
+void BM_OnForegroundAppChanged(benchmark::State& state) {
+    auto touchFeature = ::ndk::SharedRefBase::make<TouchFeature>();
+
+    TouchProfile shooter;
+    shooter.sensitivity = 1;
+    shooter.tapStability = 0;
+    TouchProfile racer;
+    racer.sensitivity = 0;
+    racer.edgeFilter = 1;
+    touchFeature->setProfile("shooter", shooter);
+    touchFeature->setProfile("racer", racer);
+    touchFeature->setAppProfile("com.example.shooter", "shooter");
+    touchFeature->setAppProfile("com.example.racer", "racer");
+
+    const char* apps[] = {"com.example.shooter", "com.example.racer"};
+    size_t app = 0;
+    for (auto _ : state) {
+        bool applied = false;
+        touchFeature->onForegroundAppChanged(apps[app], &applied);
+        if (!applied) {
+            state.SkipWithError("touch device unavailable");
+            return;
+        }
+        app ^= 1;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_OnForegroundAppChanged);
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,32 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "TouchFeature.h"
+#include "TouchFeatureExt.h"
+
+#include <android-base/logging.h>
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+
+using aidl::vendor::xiaomi::hardware::touchfeature::TouchFeatureExt;
+using aidl::vendor::xiaomi::hw::touchfeature::TouchFeature;
+
+int main() {
+    ABinderProcess_setThreadPoolMaxThreadCount(0);
+    std::shared_ptr<TouchFeature> touchFeature = ::ndk::SharedRefBase::make<TouchFeature>();
+    std::shared_ptr<TouchFeatureExt> ext =
+            ::ndk::SharedRefBase::make<TouchFeatureExt>(touchFeature);
+
+    binder_status_t status =
+            AIBinder_setExtension(touchFeature->asBinder().get(), ext->asBinder().get());
+    CHECK_EQ(status, STATUS_OK);
+
+    const std::string instance = std::string(TouchFeature::descriptor) + "/default";
+    status = AServiceManager_addService(touchFeature->asBinder().get(), instance.c_str());
+    CHECK_EQ(status, STATUS_OK);
+
+    ABinderProcess_joinThreadPool();
+    return EXIT_FAILURE;  // should not reach
+}
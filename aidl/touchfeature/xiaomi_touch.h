@@ -0,0 +1,55 @@
+/*
+ * SPDX-FileCopyrightText: 2024 The LineageOS Project
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <sys/ioctl.h>
+
+// Userspace ABI of the xiaomi_touch driver (/dev/xiaomi-touch, /sys/class/touch/touch_dev).
+// Every command takes an int[] of TOUCH_BUF_SIZE laid out as { touchId, mode, value... };
+// getters return their result in the first slot.
+
+#define TOUCH_DEV_PATH "/dev/xiaomi-touch"
+
+#define TOUCH_MAGIC 't'
+
+#define TOUCH_SET_CUR_VALUE 0
+#define TOUCH_GET_CUR_VALUE 1
+#define TOUCH_GET_DEF_VALUE 2
+#define TOUCH_GET_MIN_VALUE 3
+#define TOUCH_GET_MAX_VALUE 4
+#define TOUCH_GET_MODE_VALUE 5
+#define TOUCH_RESET_MODE 6
+#define TOUCH_SET_LONG_VALUE 7
+
+#define TOUCH_IOC_SET_CUR_VALUE _IO(TOUCH_MAGIC, TOUCH_SET_CUR_VALUE)
+#define TOUCH_IOC_GET_CUR_VALUE _IO(TOUCH_MAGIC, TOUCH_GET_CUR_VALUE)
+#define TOUCH_IOC_GET_DEF_VALUE _IO(TOUCH_MAGIC, TOUCH_GET_DEF_VALUE)
+#define TOUCH_IOC_GET_MIN_VALUE _IO(TOUCH_MAGIC, TOUCH_GET_MIN_VALUE)
+#define TOUCH_IOC_GET_MAX_VALUE _IO(TOUCH_MAGIC, TOUCH_GET_MAX_VALUE)
+#define TOUCH_IOC_GET_MODE_VALUE _IO(TOUCH_MAGIC, TOUCH_GET_MODE_VALUE)
+#define TOUCH_IOC_RESET_MODE _IO(TOUCH_MAGIC, TOUCH_RESET_MODE)
+#define TOUCH_IOC_SET_LONG_VALUE _IO(TOUCH_MAGIC, TOUCH_SET_LONG_VALUE)
+
+#define TOUCH_BUF_SIZE 256
+
+enum touch_mode {
+    Touch_Game_Mode = 0,
+    Touch_Active_MODE = 1,
+    Touch_UP_THRESHOLD = 2,
+    Touch_Tolerance = 3,
+    Touch_Aim_Sensitivity = 4,
+    Touch_Tap_Stability = 5,
+    Touch_Expert_Mode = 6,
+    Touch_Edge_Filter = 7,
+    Touch_Panel_Orientation = 8,
+    Touch_Report_Rate = 9,
+    Touch_Fod_Enable = 10,
+    Touch_Aod_Enable = 11,
+    Touch_Resist_RF = 12,
+    Touch_Idle_Time = 13,
+    Touch_Doubletap_Mode = 14,
+    Touch_Grip_Mode = 15,
+};
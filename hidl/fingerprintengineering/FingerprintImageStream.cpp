@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "FingerprintImageStream"
+
+#include "FingerprintImageStream.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <cutils/native_handle.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+#include <sstream>
+
+using ::com::fingerprints::extension::V1_0::SensorSize;
+using std::chrono::steady_clock;
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace fingerprintengineering {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr uint32_t kDefaultSlots = 8;
+constexpr uint32_t kMinSlots = 2;
+constexpr uint32_t kMaxSlots = 64;
+
+// Images are up to 16 bits per pixel
+constexpr uint32_t kBytesPerPixel = 2;
+
+// Used when the sensor size is unknown
+constexpr uint32_t kDefaultMaxImageSize = 512 * 512 * kBytesPerPixel;
+constexpr uint32_t kMaxImageSize = 2048 * 2048 * kBytesPerPixel;
+
+}  // anonymous namespace
+
+FingerprintImageStream::StreamCallback::StreamCallback(FingerprintImageStream* imageStream,
+                                                       uint64_t stream)
+    : mImageStream(imageStream), mStream(stream) {}
+
+Return<void> FingerprintImageStream::StreamCallback::onImage(
+        const ImageCaptureData& imageCaptureData) {
+    mImageStream->onImage(mStream, imageCaptureData);
+    return {};
+}
+
+Return<void> FingerprintImageStream::StreamCallback::onImageTransferData(
+        uint8_t /* type */, const hidl_vec<uint8_t>& /* buffer */) {
+    return {};
+}
+
+Return<void> FingerprintImageStream::StreamCallback::onImageFinish() {
+    mImageStream->onImageFinish(mStream);
+    return {};
+}
+
+FingerprintImageStream::FingerprintImageStream(
+        sp<extension::V2_0::IFingerprintEngineering> upstream20,
+        sp<extension::V1_0::IFingerprintEngineering> upstream10)
+    : mUpstream20(std::move(upstream20)), mUpstream10(std::move(upstream10)) {}
+
+Return<void> FingerprintImageStream::startImageStream(const sp<IImageStreamCallback>& callback,
+                                                      bool capture, uint32_t mode,
+                                                      uint32_t slotCount,
+                                                      startImageStream_cb _hidl_cb) {
+    if (callback == nullptr) {
+        _hidl_cb(-EINVAL, hidl_handle(), {});
+        return {};
+    }
+
+    slotCount = slotCount == 0 ? kDefaultSlots : std::clamp(slotCount, kMinSlots, kMaxSlots);
+
+    SensorSize sensorSize = {};
+    auto sizeRet = withUpstream([&](const auto& upstream) {
+        return upstream->getSensorSize([&](const SensorSize& size) { sensorSize = size; });
+    });
+    if (!sizeRet.isOk()) {
+        LOG(WARNING) << "Failed to get sensor size: " << sizeRet.description();
+    }
+    uint32_t maxImageSize = kDefaultMaxImageSize;
+    if (sensorSize.width > 0 && sensorSize.height > 0) {
+        maxImageSize = std::min<uint64_t>(
+                static_cast<uint64_t>(sensorSize.width) * sensorSize.height * kBytesPerPixel,
+                kMaxImageSize);
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    stopStreamLocked();
+
+    mRing = ImageRing::create(slotCount, maxImageSize);
+    if (!mRing) {
+        _hidl_cb(-ENOMEM, hidl_handle(), {});
+        return {};
+    }
+    mClient = callback;
+    mCapture = capture;
+    mStreams++;
+
+    sp<StreamCallback> streamCallback = new StreamCallback(this, ++mStream);
+    auto ret = withUpstream([&](const auto& upstream) {
+        return capture ? upstream->startCapture(streamCallback, mode)
+                       : upstream->startImageSubscription(streamCallback);
+    });
+    if (!ret.isOk()) {
+        LOG(ERROR) << "Failed to start upstream image capture: " << ret.description();
+        stopStreamLocked();
+        _hidl_cb(-EIO, hidl_handle(), {});
+        return {};
+    }
+
+    native_handle_t* ring = native_handle_create(1, 0);
+    ring->data[0] = mRing->fd();
+    _hidl_cb(0, hidl_handle(ring), mRing->layout());
+    native_handle_delete(ring);
+
+    LOG(INFO) << "Started image stream, " << mRing->layout().slotCount << " slots of "
+              << mRing->layout().slotSize << " bytes";
+    return {};
+}
+
+Return<void> FingerprintImageStream::stopImageStream() {
+    std::lock_guard<std::mutex> lock(mLock);
+    stopStreamLocked();
+    return {};
+}
+
+void FingerprintImageStream::stopStreamLocked() {
+    if (!mRing) {
+        return;
+    }
+
+    auto ret = withUpstream([&](const auto& upstream) {
+        return mCapture ? upstream->cancelCapture() : upstream->stopImageSubscription();
+    });
+    if (!ret.isOk()) {
+        LOG(WARNING) << "Failed to stop upstream image capture: " << ret.description();
+    }
+
+    // Any frame still in flight from the upstream belongs to a stale stream now
+    mStream++;
+    mClient.clear();
+    mRing.reset();
+}
+
+void FingerprintImageStream::onImage(uint64_t stream, const ImageCaptureData& data) {
+    sp<IImageStreamCallback> client;
+    int32_t slot;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (stream != mStream || !mRing) {
+            return;
+        }
+
+        auto start = steady_clock::now();
+        slot = mRing->write(data, ::android::elapsedRealtimeNano());
+        auto elapsed = steady_clock::now() - start;
+
+        if (slot < 0) {
+            mOversized++;
+            LOG(WARNING) << "Dropping frame with " << data.rawImage.size() << "+"
+                         << data.enhancedImage.size() << " bytes of images, slots fit "
+                         << mRing->layout().maxImageSize << " each";
+            return;
+        }
+
+        mFrames++;
+        mBytes += data.rawImage.size() + data.enhancedImage.size();
+        mTotalWriteTime += elapsed;
+        mMaxWriteTime = std::max<std::chrono::nanoseconds>(mMaxWriteTime, elapsed);
+        client = mClient;
+    }
+
+    auto ret = client->onImageSlot(slot);
+    if (!ret.isOk()) {
+        LOG(ERROR) << "Failed to notify image slot: " << ret.description();
+
+        std::lock_guard<std::mutex> lock(mLock);
+        mNotifyFailures++;
+        if (stream == mStream) {
+            stopStreamLocked();
+        }
+    }
+}
+
+void FingerprintImageStream::onImageFinish(uint64_t stream) {
+    sp<IImageStreamCallback> client;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (stream != mStream || !mClient) {
+            return;
+        }
+        client = mClient;
+    }
+
+    auto ret = client->onImageFinish();
+    if (!ret.isOk()) {
+        LOG(ERROR) << "Failed to notify image finish: " << ret.description();
+    }
+}
+
+Return<void> FingerprintImageStream::debug(const hidl_handle& fd,
+                                           const hidl_vec<hidl_string>& /* args */) {
+    if (fd == nullptr || fd->numFds < 1) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    std::ostringstream stream;
+    stream << "FingerprintImageStream:" << std::endl;
+    stream << "  Upstream: " << (mUpstream20 ? "@2.0" : "@1.0") << std::endl;
+    if (mRing) {
+        const auto& layout = mRing->layout();
+        stream << "  Stream: " << (mCapture ? "capture" : "subscription") << ", "
+               << layout.slotCount << " slots of " << layout.slotSize << " bytes, "
+               << mRing->frames() << " frames" << std::endl;
+    } else {
+        stream << "  Stream: none" << std::endl;
+    }
+    stream << "  Streams: " << mStreams << ", frames: " << mFrames << ", oversized: " << mOversized
+           << ", notify failures: " << mNotifyFailures << std::endl;
+
+    if (mFrames > 0) {
+        stream << "  Ring write avg: " << (mTotalWriteTime / mFrames).count()
+               << " ns, max: " << mMaxWriteTime.count() << " ns, "
+               << mBytes * 1e3 / std::max<int64_t>(mTotalWriteTime.count(), 1) << " MB/s"
+               << std::endl;
+    }
+
+    ::android::base::WriteStringToFd(stream.str(), fd->data[0]);
+    return {};
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace fingerprintengineering
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
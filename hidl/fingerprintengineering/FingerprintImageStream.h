@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <com/fingerprints/extension/1.0/IFingerprintEngineering.h>
+#include <com/fingerprints/extension/2.0/IFingerprintEngineering.h>
+#include <vendor/xiaomi/hardware/fingerprintengineering/1.0/IFingerprintImageStream.h>
+
+#include "ImageRing.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace fingerprintengineering {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::sp;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::com::fingerprints::extension::V1_0::IImageCaptureCallback;
+using ::com::fingerprints::extension::V1_0::ImageCaptureData;
+
+namespace extension = ::com::fingerprints::extension;
+
+/*
+ * Streams images from the vendor's com.fingerprints.extension @2.0 or @1.0 engineering
+ * service. Each stream subscribes upstream and copies every frame into an ImageRing. Other
+ * engineering calls go to the vendor service directly.
+ */
+class FingerprintImageStream : public IFingerprintImageStream {
+  public:
+    FingerprintImageStream(sp<extension::V2_0::IFingerprintEngineering> upstream20,
+                           sp<extension::V1_0::IFingerprintEngineering> upstream10);
+
+    // Methods from ::vendor::xiaomi::hardware::fingerprintengineering::V1_0 follow.
+    Return<void> startImageStream(const sp<IImageStreamCallback>& callback, bool capture,
+                                  uint32_t mode, uint32_t slotCount,
+                                  startImageStream_cb _hidl_cb) override;
+    Return<void> stopImageStream() override;
+
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
+  private:
+    // Upstream capture callback of one stream, frames of a stream that was replaced are dropped
+    class StreamCallback : public IImageCaptureCallback {
+      public:
+        StreamCallback(FingerprintImageStream* imageStream, uint64_t stream);
+
+        Return<void> onImage(const ImageCaptureData& imageCaptureData) override;
+        Return<void> onImageTransferData(uint8_t type, const hidl_vec<uint8_t>& buffer) override;
+        Return<void> onImageFinish() override;
+
+      private:
+        FingerprintImageStream* mImageStream;
+        uint64_t mStream;
+    };
+
+    template <typename F>
+    auto withUpstream(F&& f) {
+        return mUpstream20 ? f(mUpstream20) : f(mUpstream10);
+    }
+
+    void onImage(uint64_t stream, const ImageCaptureData& data);
+    void onImageFinish(uint64_t stream);
+    void stopStreamLocked();
+
+    sp<extension::V2_0::IFingerprintEngineering> mUpstream20;
+    sp<extension::V1_0::IFingerprintEngineering> mUpstream10;
+
+    std::mutex mLock;
+    sp<IImageStreamCallback> mClient;
+    std::unique_ptr<ImageRing> mRing;
+    bool mCapture = false;
+    uint64_t mStream = 0;
+
+    // Statistics, guarded by mLock
+    uint64_t mStreams = 0;
+    uint64_t mFrames = 0;
+    uint64_t mBytes = 0;
+    uint64_t mOversized = 0;
+    uint64_t mNotifyFailures = 0;
+    std::chrono::nanoseconds mTotalWriteTime{0};
+    std::chrono::nanoseconds mMaxWriteTime{0};
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace fingerprintengineering
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
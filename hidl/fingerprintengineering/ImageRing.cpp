@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "FingerprintImageStream"
+
+#include "ImageRing.h"
+
+#include <android-base/logging.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+
+using ::android::base::unique_fd;
+using ::com::fingerprints::extension::V1_0::ImageCaptureData;
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace fingerprintengineering {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+// Keep every slot header on its own cache line
+constexpr uint32_t kSlotAlignment = 64;
+
+uint32_t alignUp(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // anonymous namespace
+
+std::unique_ptr<ImageRing> ImageRing::create(uint32_t slotCount, uint32_t maxImageSize) {
+    ImageRingLayout layout = {
+            .slotCount = slotCount,
+            .slotSize = alignUp(sizeof(ImageSlotHeader) + 2 * maxImageSize, kSlotAlignment),
+            .maxImageSize = maxImageSize,
+    };
+    size_t size = static_cast<size_t>(layout.slotCount) * layout.slotSize;
+
+    unique_fd fd(memfd_create("fpc_image_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (!fd.ok()) {
+        PLOG(ERROR) << "Failed to create image ring";
+        return nullptr;
+    }
+    if (ftruncate(fd.get(), size) < 0) {
+        PLOG(ERROR) << "Failed to size image ring to " << size << " bytes";
+        return nullptr;
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (base == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to map image ring";
+        return nullptr;
+    }
+
+    // Only our mapping may write, clients can map the ring read only
+    int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#ifdef F_SEAL_FUTURE_WRITE
+    seals |= F_SEAL_FUTURE_WRITE;
+#endif
+    if (fcntl(fd.get(), F_ADD_SEALS, seals) < 0) {
+        PLOG(WARNING) << "Failed to seal image ring";
+    }
+
+    return std::unique_ptr<ImageRing>(
+            new ImageRing(std::move(fd), static_cast<uint8_t*>(base), layout));
+}
+
+ImageRing::ImageRing(unique_fd fd, uint8_t* base, const ImageRingLayout& layout)
+    : mFd(std::move(fd)), mBase(base), mLayout(layout) {}
+
+ImageRing::~ImageRing() {
+    munmap(mBase, static_cast<size_t>(mLayout.slotCount) * mLayout.slotSize);
+}
+
+int32_t ImageRing::write(const ImageCaptureData& data, int64_t timestampNs) {
+    if (data.rawImage.size() > mLayout.maxImageSize ||
+        data.enhancedImage.size() > mLayout.maxImageSize) {
+        return -1;
+    }
+
+    uint64_t frame = ++mFrames;
+    int32_t slot = (frame - 1) % mLayout.slotCount;
+    uint8_t* base = mBase + static_cast<size_t>(slot) * mLayout.slotSize;
+    auto header = reinterpret_cast<ImageSlotHeader*>(base);
+
+    __atomic_store_n(&header->sequence, 2 * frame - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    header->timestampNs = timestampNs;
+    header->mode = data.mode;
+    header->captureResult = data.captureResult;
+    header->identifyResult = data.identifyResult;
+    header->templateUpdateResult = data.templateUpdateResult;
+    header->enrollResult = data.enrollResult;
+    header->cacResult = data.cacResult;
+    header->userId = data.userId;
+    header->remainingSamples = data.remainingSamples;
+    header->coverage = data.coverage;
+    header->quality = data.quality;
+    header->rawImageSize = data.rawImage.size();
+    header->enhancedImageSize = data.enhancedImage.size();
+
+    uint8_t* images = base + sizeof(ImageSlotHeader);
+    memcpy(images, data.rawImage.data(), data.rawImage.size());
+    memcpy(images + mLayout.maxImageSize, data.enhancedImage.data(), data.enhancedImage.size());
+
+    __atomic_store_n(&header->sequence, 2 * frame, __ATOMIC_RELEASE);
+
+    return slot;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace fingerprintengineering
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <com/fingerprints/extension/1.0/types.h>
+#include <vendor/xiaomi/hardware/fingerprintengineering/1.0/types.h>
+
+#include <android-base/unique_fd.h>
+
+#include <memory>
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace fingerprintengineering {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Fixed size slots in a sealed memfd, written in turn by a single writer. Each slot starts with
+ * an ImageSlotHeader whose sequence works as a seqlock, so readers can tell a complete frame
+ * from one that was overwritten while they copied it.
+ */
+class ImageRing {
+  public:
+    static std::unique_ptr<ImageRing> create(uint32_t slotCount, uint32_t maxImageSize);
+    ~ImageRing();
+
+    int fd() const { return mFd.get(); }
+    const ImageRingLayout& layout() const { return mLayout; }
+    uint64_t frames() const { return mFrames; }
+
+    // Returns the slot the frame went to, -1 if its images don't fit a slot
+    int32_t write(const ::com::fingerprints::extension::V1_0::ImageCaptureData& data,
+                  int64_t timestampNs);
+
+  private:
+    ImageRing(::android::base::unique_fd fd, uint8_t* base, const ImageRingLayout& layout);
+
+    ::android::base::unique_fd mFd;
+    uint8_t* mBase;
+    ImageRingLayout mLayout;
+    uint64_t mFrames = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace fingerprintengineering
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.xiaomi.hardware.fingerprintengineering@1.0-service.xiaomi"
+
+#include <android-base/logging.h>
+#include <hidl/HidlTransportSupport.h>
+
+#include "FingerprintImageStream.h"
+
+using ::vendor::xiaomi::hardware::fingerprintengineering::V1_0::IFingerprintImageStream;
+using ::vendor::xiaomi::hardware::fingerprintengineering::V1_0::implementation::
+        FingerprintImageStream;
+
+namespace V1_0 = ::com::fingerprints::extension::V1_0;
+namespace V2_0 = ::com::fingerprints::extension::V2_0;
+
+int main() {
+    // Frames come from the vendor engineering service, whichever version it serves
+    android::sp<V2_0::IFingerprintEngineering> upstream20 =
+            V2_0::IFingerprintEngineering::getService();
+    android::sp<V1_0::IFingerprintEngineering> upstream10;
+    if (upstream20 == nullptr) {
+        upstream10 = V1_0::IFingerprintEngineering::getService();
+    }
+    if (upstream20 == nullptr && upstream10 == nullptr) {
+        LOG(ERROR) << "Cannot get the vendor IFingerprintEngineering service.";
+        return 1;
+    }
+
+    android::sp<IFingerprintImageStream> imageStream =
+            new FingerprintImageStream(upstream20, upstream10);
+
+    android::hardware::configureRpcThreadpool(2, true);
+
+    if (imageStream->registerAsService() != android::OK) {
+        LOG(ERROR) << "Cannot register FingerprintImageStream HAL service.";
+        return 1;
+    }
+
+    LOG(INFO) << "FingerprintImageStream HAL service ready.";
+
+    android::hardware::joinRpcThreadpool();
+
+    LOG(ERROR) << "FingerprintImageStream HAL service failed to join thread pool.";
+    return 1;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "ImageRing.h"
+
+using ::com::fingerprints::extension::V1_0::ImageCaptureData;
+using ::vendor::xiaomi::hardware::fingerprintengineering::V1_0::ImageRingLayout;
+using ::vendor::xiaomi::hardware::fingerprintengineering::V1_0::ImageSlotHeader;
+using ::vendor::xiaomi::hardware::fingerprintengineering::V1_0::implementation::ImageRing;
+
+namespace {
+
+// 160x160 at 16 bits per pixel, like the largest sensors getSensorSize reports
+constexpr uint32_t kMaxImageSize = 160 * 160 * 2;
+constexpr uint32_t kSlots = 4;
+constexpr uint64_t kStreamFrames = 20000;
+
+// The streaming test cycles through 7 prepared frames, images only depend on frame % 7
+uint32_t imageSize(uint64_t frame) {
+    return kMaxImageSize - (frame % 7) * 64;
+}
+
+int8_t pixel(uint64_t frame) {
+    return static_cast<int8_t>(frame % 7 + 1);
+}
+
+ImageCaptureData makeFrame(uint64_t frame) {
+    ImageCaptureData data = {};
+    data.quality = static_cast<int32_t>(frame);
+    data.rawImage.resize(imageSize(frame));
+    memset(data.rawImage.data(), pixel(frame), data.rawImage.size());
+    data.enhancedImage.resize(imageSize(frame + 1));
+    memset(data.enhancedImage.data(), -pixel(frame), data.enhancedImage.size());
+    return data;
+}
+
+/*
+ * A client mapping of the ring, reading slots the way the interface documents: copy the slot
+ * out, then keep it only if the sequence was even and unchanged across the copy.
+ */
+class RingReader {
+  public:
+    explicit RingReader(const ImageRing& ring) : mLayout(ring.layout()) {
+        mSize = static_cast<size_t>(mLayout.slotCount) * mLayout.slotSize;
+        void* base = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, ring.fd(), 0);
+        mBase = base == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(base);
+    }
+
+    ~RingReader() {
+        if (mBase) {
+            munmap(const_cast<uint8_t*>(mBase), mSize);
+        }
+    }
+
+    bool mapped() const { return mBase != nullptr; }
+
+    // Returns the frame number read from the slot, 0 if it had no complete frame
+    uint64_t read(uint32_t slot, ImageSlotHeader* header, std::vector<int8_t>* raw) {
+        const uint8_t* base = mBase + static_cast<size_t>(slot) * mLayout.slotSize;
+        auto shared = reinterpret_cast<const ImageSlotHeader*>(base);
+
+        uint64_t sequence = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (sequence == 0 || (sequence & 1)) {
+            return 0;
+        }
+        memcpy(header, shared, sizeof(*header));
+        raw->resize(std::min(header->rawImageSize, mLayout.maxImageSize));
+        memcpy(raw->data(), base + sizeof(ImageSlotHeader), raw->size());
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) != sequence) {
+            return 0;
+        }
+        return sequence / 2;
+    }
+
+  private:
+    const ImageRingLayout mLayout;
+    const uint8_t* mBase;
+    size_t mSize;
+};
+
+bool frameMatches(uint64_t frame, const ImageSlotHeader& header, const std::vector<int8_t>& raw) {
+    if (header.quality != static_cast<int32_t>(frame) || raw.size() != imageSize(frame)) {
+        return false;
+    }
+    return std::all_of(raw.begin(), raw.end(), [&](int8_t p) { return p == pixel(frame); });
+}
+
+}  // anonymous namespace
+
+TEST(ImageRingTest, WritesSlotsInTurn) {
+    auto ring = ImageRing::create(kSlots, kMaxImageSize);
+    ASSERT_NE(ring, nullptr);
+    RingReader reader(*ring);
+    ASSERT_TRUE(reader.mapped());
+
+    for (uint64_t frame = 1; frame <= kSlots + 2; frame++) {
+        EXPECT_EQ(ring->write(makeFrame(frame), 0), static_cast<int32_t>((frame - 1) % kSlots));
+    }
+    EXPECT_EQ(ring->frames(), kSlots + 2);
+
+    ImageSlotHeader header;
+    std::vector<int8_t> raw;
+    EXPECT_EQ(reader.read(0, &header, &raw), kSlots + 1);
+    EXPECT_TRUE(frameMatches(kSlots + 1, header, raw));
+    EXPECT_EQ(header.enhancedImageSize, imageSize(kSlots + 2));
+    EXPECT_EQ(reader.read(2, &header, &raw), 3u);
+    EXPECT_TRUE(frameMatches(3, header, raw));
+}
+
+TEST(ImageRingTest, DropsFramesThatDontFit) {
+    auto ring = ImageRing::create(kSlots, kMaxImageSize);
+    ASSERT_NE(ring, nullptr);
+
+    ImageCaptureData data = makeFrame(1);
+    data.enhancedImage.resize(kMaxImageSize + 1);
+    EXPECT_EQ(ring->write(data, 0), -1);
+    EXPECT_EQ(ring->frames(), 0u);
+}
+
+TEST(ImageRingTest, ClientsCannotMapItWritable) {
+    auto ring = ImageRing::create(kSlots, kMaxImageSize);
+    ASSERT_NE(ring, nullptr);
+
+#ifdef F_SEAL_FUTURE_WRITE
+    if (!(fcntl(ring->fd(), F_GET_SEALS) & F_SEAL_FUTURE_WRITE)) {
+        GTEST_SKIP() << "Kernel does not support F_SEAL_FUTURE_WRITE";
+    }
+    size_t size = static_cast<size_t>(ring->layout().slotCount) * ring->layout().slotSize;
+    EXPECT_EQ(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd(), 0), MAP_FAILED);
+#else
+    GTEST_SKIP() << "F_SEAL_FUTURE_WRITE is not defined";
+#endif
+}
+
+/*
+ * A reader following a writer at full speed: every frame it accepts is complete, and frame
+ * numbers only move forward.
+ */
+TEST(ImageRingTest, StreamingReaderNeverSeesTornFrames) {
+    auto ring = ImageRing::create(kSlots, kMaxImageSize);
+    ASSERT_NE(ring, nullptr);
+    RingReader reader(*ring);
+    ASSERT_TRUE(reader.mapped());
+
+    std::vector<ImageCaptureData> frames;
+    for (uint64_t frame = 0; frame < 7; frame++) {
+        frames.push_back(makeFrame(frame));
+    }
+
+    std::atomic<bool> done = false;
+    std::atomic<uint64_t> written = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::thread writer([&] {
+        for (uint64_t frame = 1; frame <= kStreamFrames; frame++) {
+            ImageCaptureData& data = frames[frame % frames.size()];
+            data.quality = static_cast<int32_t>(frame);
+            ring->write(data, 0);
+            written.store(frame, std::memory_order_release);
+        }
+        done = true;
+    });
+
+    uint64_t accepted = 0, torn = 0, backwards = 0, lastFrame = 0;
+    ImageSlotHeader header;
+    std::vector<int8_t> raw;
+    while (!done) {
+        uint64_t latest = written.load(std::memory_order_acquire);
+        if (latest == 0) {
+            continue;
+        }
+        uint64_t frame = reader.read((latest - 1) % kSlots, &header, &raw);
+        if (frame == 0) {
+            continue;
+        }
+        accepted++;
+        if (!frameMatches(frame, header, raw)) {
+            torn++;
+        }
+        if (frame < lastFrame) {
+            backwards++;
+        }
+        lastFrame = frame;
+    }
+    writer.join();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(torn, 0u);
+    EXPECT_EQ(backwards, 0u);
+    EXPECT_GT(accepted, 0u);
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    RecordProperty("frames_per_second",
+                   std::to_string(static_cast<int64_t>(kStreamFrames / seconds)));
+    RecordProperty("accepted_frames", std::to_string(accepted));
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "MiFxTunnel"
+
+#include "MiFxTunnel.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <hwbinder/IPCThreadState.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+using ::android::hardware::IPCThreadState;
+using std::chrono::steady_clock;
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace fx {
+namespace tunnel {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+constexpr int32_t kVersion = 0x0101;
+
+// Pooled out_buf storage above this is given back after the call
+constexpr size_t kMaxPooledCapacity = 64 * 1024;
+
+constexpr size_t kMaxSharedBuffers = 8;
+constexpr uint32_t kMaxSharedBufferSize = 16 * 1024 * 1024;
+
+constexpr size_t kSizeBuckets[] = {64, 1024, 4096, 64 * 1024, 1024 * 1024};
+
+size_t sizeBucket(size_t bytes) {
+    return std::lower_bound(std::begin(kSizeBuckets), std::end(kSizeBuckets), bytes) -
+           std::begin(kSizeBuckets);
+}
+
+}  // anonymous namespace
+
+MiFxTunnel::Mapping::Mapping(void* base, size_t size, pid_t owner)
+    : base(static_cast<int8_t*>(base)), size(size), owner(owner) {}
+
+MiFxTunnel::Mapping::~Mapping() {
+    munmap(base, size);
+}
+
+MiFxTunnel::MiFxTunnel() {
+    registerCommand(kCmdGetVersion, [](const int8_t*, size_t, OutBuffer* out) {
+        int8_t* data = out->append(sizeof(kVersion));
+        if (!data) {
+            return -ENOSPC;
+        }
+        memcpy(data, &kVersion, sizeof(kVersion));
+        return 0;
+    });
+
+    registerCommand(kCmdEcho, [](const int8_t* params, size_t paramsSize, OutBuffer* out) {
+        int8_t* data = out->append(paramsSize);
+        if (!data) {
+            return -ENOSPC;
+        }
+        memmove(data, params, paramsSize);
+        return 0;
+    });
+}
+
+void MiFxTunnel::loadDeviceCommands() {
+    void* lib = dlopen(MI_FX_TUNNEL_COMMANDS_LIB_NAME, RTLD_NOW);
+    if (!lib) {
+        LOG(INFO) << "No device commands, only the built in ones are available";
+        return;
+    }
+
+    auto commands = static_cast<MiFxTunnelCommands*>(dlsym(lib, MI_FX_TUNNEL_COMMANDS));
+    if (!commands || !commands->registerCommands) {
+        LOG(ERROR) << MI_FX_TUNNEL_COMMANDS_LIB_NAME << " has no " << MI_FX_TUNNEL_COMMANDS;
+        dlclose(lib);
+        return;
+    }
+
+    // The handlers live in the library, it stays loaded for the life of the service
+    size_t builtIn = mCommands.size();
+    commands->registerCommands(this);
+    LOG(INFO) << "Registered " << mCommands.size() - builtIn << " device commands";
+}
+
+bool MiFxTunnel::registerCommand(int32_t cmdId, CommandHandler handler) {
+    auto it = std::lower_bound(mCommands.begin(), mCommands.end(), cmdId,
+                               [](const auto& entry, int32_t id) { return entry.first < id; });
+    if (it != mCommands.end() && it->first == cmdId) {
+        LOG(ERROR) << "Command " << cmdId << " is already registered";
+        return false;
+    }
+
+    mCommands.insert(it, {cmdId, std::move(handler)});
+    return true;
+}
+
+int32_t MiFxTunnel::dispatch(int32_t cmdId, const int8_t* params, size_t paramsSize,
+                             OutBuffer* out) {
+    auto it = std::lower_bound(mCommands.begin(), mCommands.end(), cmdId,
+                               [](const auto& entry, int32_t id) { return entry.first < id; });
+    if (it == mCommands.end() || it->first != cmdId) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mUnknownCommands++;
+        return -EOPNOTSUPP;
+    }
+
+    return it->second(params, paramsSize, out);
+}
+
+void MiFxTunnel::recordCall(bool shared, size_t bytes, std::chrono::nanoseconds time) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto& stats = mStats[shared][sizeBucket(bytes)];
+    stats.calls++;
+    stats.bytes += bytes;
+    stats.time += time;
+}
+
+Return<void> MiFxTunnel::setNotify(const sp<IMiFxTunnelCallback>& callback) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mCallback = callback;
+    return {};
+}
+
+/*
+ * params is read in place from the transaction and out_buf is handed back from per thread
+ * storage reused across calls, so neither side is copied into an intermediate hidl_vec.
+ */
+Return<void> MiFxTunnel::invokeCommand(int32_t cmdId, const hidl_vec<int8_t>& params,
+                                       invokeCommand_cb _hidl_cb) {
+    thread_local std::vector<int8_t> tOutStorage;
+
+    const auto start = steady_clock::now();
+    OutBuffer out(&tOutStorage);
+    int32_t result = dispatch(cmdId, params.data(), params.size(), &out);
+
+    hidl_vec<int8_t> outBuf;
+    outBuf.setToExternal(tOutStorage.data(), tOutStorage.size());
+    _hidl_cb(result, outBuf);
+
+    recordCall(false, params.size() + out.size(), steady_clock::now() - start);
+
+    if (tOutStorage.capacity() > kMaxPooledCapacity) {
+        std::vector<int8_t>().swap(tOutStorage);
+    }
+
+    return {};
+}
+
+Return<void> MiFxTunnel::registerSharedBuffer(const hidl_handle& buffer, uint32_t size,
+                                              registerSharedBuffer_cb _hidl_cb) {
+    if (buffer == nullptr || buffer->numFds < 1 || size == 0 || size > kMaxSharedBufferSize) {
+        _hidl_cb(-EINVAL, 0);
+        return {};
+    }
+
+    const int fd = buffer->data[0];
+
+    // Pages the client truncates away under the mapping would SIGBUS the service on access
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        LOG(ERROR) << "Shared buffer is not sealed against shrinking";
+        _hidl_cb(-EPERM, 0);
+        return {};
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<uint64_t>(st.st_size) < size) {
+        LOG(ERROR) << "Shared buffer is smaller than " << size << " bytes";
+        _hidl_cb(-EINVAL, 0);
+        return {};
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        PLOG(ERROR) << "Failed to map shared buffer of " << size << " bytes";
+        _hidl_cb(-err, 0);
+        return {};
+    }
+
+    auto mapping = std::make_shared<Mapping>(base, size, IPCThreadState::self()->getCallingPid());
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mSharedBuffers.size() >= kMaxSharedBuffers) {
+        _hidl_cb(-ENOSPC, 0);
+        return {};
+    }
+
+    int32_t bufferId = mNextBufferId++;
+    mSharedBuffers.emplace(bufferId, std::move(mapping));
+    _hidl_cb(0, bufferId);
+    return {};
+}
+
+Return<int32_t> MiFxTunnel::unregisterSharedBuffer(int32_t bufferId) {
+    const pid_t caller = IPCThreadState::self()->getCallingPid();
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mSharedBuffers.find(bufferId);
+    if (it == mSharedBuffers.end() || it->second->owner != caller) {
+        return -ENOENT;
+    }
+
+    // Calls still running on it keep the mapping alive
+    mSharedBuffers.erase(it);
+    return 0;
+}
+
+Return<void> MiFxTunnel::invokeCommandShared(int32_t cmdId, int32_t bufferId, uint32_t paramsSize,
+                                             invokeCommandShared_cb _hidl_cb) {
+    const auto start = steady_clock::now();
+    const pid_t caller = IPCThreadState::self()->getCallingPid();
+
+    std::shared_ptr<Mapping> mapping;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mSharedBuffers.find(bufferId);
+        if (it != mSharedBuffers.end() && it->second->owner == caller) {
+            mapping = it->second;
+        }
+    }
+
+    if (!mapping) {
+        _hidl_cb(-ENOENT, 0);
+        return {};
+    }
+
+    // Computed in 64 bits, rounding a paramsSize near UINT32_MAX up wraps a 32 bit size_t
+    const uint64_t outOffset = (static_cast<uint64_t>(paramsSize) + 7) & ~uint64_t(7);
+    if (outOffset > mapping->size) {
+        _hidl_cb(-EINVAL, 0);
+        return {};
+    }
+
+    OutBuffer out(mapping->base + outOffset, mapping->size - outOffset);
+    int32_t result = dispatch(cmdId, mapping->base, paramsSize, &out);
+    _hidl_cb(result, out.size());
+
+    recordCall(true, paramsSize + out.size(), steady_clock::now() - start);
+    return {};
+}
+
+Return<void> MiFxTunnel::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* args */) {
+    if (fd == nullptr || fd->numFds < 1) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    std::ostringstream stream;
+    stream << "MiFxTunnel:" << std::endl;
+    stream << "  Commands:";
+    for (const auto& [cmdId, handler] : mCommands) {
+        stream << " " << cmdId;
+    }
+    stream << ", unknown command calls: " << mUnknownCommands << std::endl;
+    stream << "  Shared buffers: " << mSharedBuffers.size() << "/" << kMaxSharedBuffers
+           << std::endl;
+
+    for (int shared = 0; shared < 2; shared++) {
+        stream << "  " << (shared ? "Shared" : "Inline") << " calls by payload size:" << std::endl;
+        for (size_t bucket = 0; bucket < mStats[shared].size(); bucket++) {
+            const auto& stats = mStats[shared][bucket];
+            if (stats.calls == 0) {
+                continue;
+            }
+
+            stream << "    ";
+            if (bucket < std::size(kSizeBuckets)) {
+                stream << "<= " << kSizeBuckets[bucket];
+            } else {
+                stream << "> " << kSizeBuckets[bucket - 1];
+            }
+            stream << " bytes: " << stats.calls << " calls, "
+                   << stats.calls * 1e9 / std::max<int64_t>(stats.time.count(), 1)
+                   << " calls/s, " << stats.bytes * 1e3 / std::max<int64_t>(stats.time.count(), 1)
+                   << " MB/s" << std::endl;
+        }
+    }
+
+    ::android::base::WriteStringToFd(stream.str(), fd->data[0]);
+    return {};
+}
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace tunnel
+}  // namespace fx
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
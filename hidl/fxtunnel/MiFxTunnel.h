@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <vendor/xiaomi/hardware/fx/tunnel/1.1/IMiFxTunnel.h>
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "MiFxTunnelCommands.h"
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace fx {
+namespace tunnel {
+namespace V1_1 {
+namespace implementation {
+
+using ::android::sp;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::vendor::xiaomi::hardware::fx::tunnel::V1_0::IMiFxTunnelCallback;
+
+// Built in commands
+constexpr int32_t kCmdGetVersion = 0;
+constexpr int32_t kCmdEcho = 1;
+
+class MiFxTunnel : public IMiFxTunnel, public CommandRegistry {
+  public:
+    MiFxTunnel();
+
+    // Adds the device's commands from MI_FX_TUNNEL_COMMANDS_LIB_NAME, if it has one. Must be
+    // called before the service is registered.
+    void loadDeviceCommands();
+
+    bool registerCommand(int32_t cmdId, CommandHandler handler) override;
+
+    // Methods from ::vendor::xiaomi::hardware::fx::tunnel::V1_0::IMiFxTunnel follow.
+    Return<void> setNotify(const sp<IMiFxTunnelCallback>& callback) override;
+    Return<void> invokeCommand(int32_t cmdId, const hidl_vec<int8_t>& params,
+                               invokeCommand_cb _hidl_cb) override;
+
+    // Methods from ::vendor::xiaomi::hardware::fx::tunnel::V1_1::IMiFxTunnel follow.
+    Return<void> registerSharedBuffer(const hidl_handle& buffer, uint32_t size,
+                                      registerSharedBuffer_cb _hidl_cb) override;
+    Return<int32_t> unregisterSharedBuffer(int32_t bufferId) override;
+    Return<void> invokeCommandShared(int32_t cmdId, int32_t bufferId, uint32_t paramsSize,
+                                     invokeCommandShared_cb _hidl_cb) override;
+
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
+  private:
+    struct Mapping {
+        Mapping(void* base, size_t size, pid_t owner);
+        ~Mapping();
+
+        int8_t* const base;
+        const size_t size;
+        const pid_t owner;
+    };
+
+    struct SizeStats {
+        uint64_t calls = 0;
+        uint64_t bytes = 0;
+        std::chrono::nanoseconds time{0};
+    };
+
+    int32_t dispatch(int32_t cmdId, const int8_t* params, size_t paramsSize, OutBuffer* out);
+    void recordCall(bool shared, size_t bytes, std::chrono::nanoseconds time);
+
+    // Sorted by command id, only written before the service is registered
+    std::vector<std::pair<int32_t, CommandHandler>> mCommands;
+
+    std::mutex mLock;
+    sp<IMiFxTunnelCallback> mCallback;
+    std::map<int32_t, std::shared_ptr<Mapping>> mSharedBuffers;
+    int32_t mNextBufferId = 1;
+
+    // Statistics per payload size bucket, inline and shared, guarded by mLock
+    std::array<std::array<SizeStats, 6>, 2> mStats;
+    uint64_t mUnknownCommands = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace tunnel
+}  // namespace fx
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
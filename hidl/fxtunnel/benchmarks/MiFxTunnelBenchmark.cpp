@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <cutils/native_handle.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vendor/xiaomi/hardware/fx/tunnel/1.1/IMiFxTunnel.h>
+
+#include <cstring>
+#include <vector>
+
+using ::android::sp;
+using ::android::base::unique_fd;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_vec;
+using ::vendor::xiaomi::hardware::fx::tunnel::V1_1::IMiFxTunnel;
+
+namespace {
+
+// Echo hands params back as out_buf, so every byte crosses the tunnel both ways
+constexpr int32_t kCmdEcho = 1;
+
+sp<IMiFxTunnel> getTunnel() {
+    static sp<IMiFxTunnel> tunnel = IMiFxTunnel::getService();
+    return tunnel;
+}
+
+void BM_InvokeCommand(benchmark::State& state) {
+    sp<IMiFxTunnel> tunnel = getTunnel();
+    if (tunnel == nullptr) {
+        state.SkipWithError("IMiFxTunnel is not running");
+        return;
+    }
+
+    std::vector<int8_t> params(state.range(0), 0x5a);
+    hidl_vec<int8_t> paramsVec;
+    paramsVec.setToExternal(params.data(), params.size());
+
+    for (auto _ : state) {
+        int32_t result = -1;
+        tunnel->invokeCommand(kCmdEcho, paramsVec,
+                              [&result](int32_t resultCode, const hidl_vec<int8_t>& outBuf) {
+                                  result = resultCode;
+                                  benchmark::DoNotOptimize(outBuf.data());
+                              });
+        if (result != 0) {
+            state.SkipWithError("invokeCommand failed");
+            return;
+        }
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 2);
+}
+// Inline payloads travel in the transaction, which is capped well below 1 MiB
+BENCHMARK(BM_InvokeCommand)->RangeMultiplier(4)->Range(64, 256 * 1024);
+
+void BM_InvokeCommandShared(benchmark::State& state) {
+    sp<IMiFxTunnel> tunnel = getTunnel();
+    if (tunnel == nullptr) {
+        state.SkipWithError("IMiFxTunnel is not running");
+        return;
+    }
+
+    // Room for params and the echoed out_buf behind them
+    const size_t paramsSize = state.range(0);
+    const size_t size = ((paramsSize + 7) & ~size_t(7)) + paramsSize;
+
+    unique_fd fd(memfd_create("fx_tunnel_benchmark", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (!fd.ok() || ftruncate(fd.get(), size) < 0 ||
+        fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        state.SkipWithError("Failed to create shared buffer");
+        return;
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (base == MAP_FAILED) {
+        state.SkipWithError("Failed to map shared buffer");
+        return;
+    }
+    memset(base, 0x5a, paramsSize);
+
+    native_handle_t* handle = native_handle_create(1 /* numFds */, 0 /* numInts */);
+    handle->data[0] = fd.get();
+
+    int32_t bufferId = -1;
+    tunnel->registerSharedBuffer(hidl_handle(handle), size,
+                                 [&bufferId](int32_t resultCode, int32_t id) {
+                                     bufferId = resultCode == 0 ? id : -1;
+                                 });
+    native_handle_delete(handle);
+
+    if (bufferId < 0) {
+        state.SkipWithError("registerSharedBuffer failed");
+    } else {
+        for (auto _ : state) {
+            int32_t result = -1;
+            tunnel->invokeCommandShared(kCmdEcho, bufferId, paramsSize,
+                                        [&result](int32_t resultCode, uint32_t /* outSize */) {
+                                            result = resultCode;
+                                        });
+            if (result != 0) {
+                state.SkipWithError("invokeCommandShared failed");
+                break;
+            }
+        }
+
+        tunnel->unregisterSharedBuffer(bufferId);
+        state.SetBytesProcessed(state.iterations() * paramsSize * 2);
+    }
+
+    munmap(base, size);
+}
+BENCHMARK(BM_InvokeCommandShared)->RangeMultiplier(4)->Range(64, 4 * 1024 * 1024);
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
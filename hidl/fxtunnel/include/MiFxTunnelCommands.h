@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#define MI_FX_TUNNEL_COMMANDS_LIB_NAME "libmifxtunnelcommands.so"
+#define MI_FX_TUNNEL_COMMANDS "MI_FX_TUNNEL_COMMANDS"
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace fx {
+namespace tunnel {
+namespace V1_1 {
+namespace implementation {
+
+/*
+ * Where a command handler writes out_buf: either pooled storage that grows as needed, or the
+ * fixed space left in a shared buffer.
+ */
+class OutBuffer {
+  public:
+    explicit OutBuffer(std::vector<int8_t>* storage) : mStorage(storage) { mStorage->clear(); }
+    OutBuffer(int8_t* data, size_t capacity) : mData(data), mCapacity(capacity) {}
+
+    // Returns room for size more bytes, nullptr if a fixed buffer can't fit them
+    int8_t* append(size_t size) {
+        if (mStorage) {
+            mStorage->resize(mSize + size);
+            mData = mStorage->data();
+        } else if (size > mCapacity - mSize) {
+            return nullptr;
+        }
+
+        int8_t* out = mData + mSize;
+        mSize += size;
+        return out;
+    }
+
+    size_t size() const { return mSize; }
+
+  private:
+    std::vector<int8_t>* mStorage = nullptr;
+    int8_t* mData = nullptr;
+    size_t mCapacity = 0;
+    size_t mSize = 0;
+};
+
+// Params may live in memory shared with the client, handlers must not trust them across reads
+using CommandHandler =
+        std::function<int32_t(const int8_t* params, size_t paramsSize, OutBuffer* out)>;
+
+class CommandRegistry {
+  public:
+    virtual ~CommandRegistry() = default;
+
+    // Returns false if cmdId already has a handler
+    virtual bool registerCommand(int32_t cmdId, CommandHandler handler) = 0;
+};
+
+// Exported by a device's libmifxtunnelcommands.so as MI_FX_TUNNEL_COMMANDS
+struct MiFxTunnelCommands {
+    void (*registerCommands)(CommandRegistry* registry);
+};
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace tunnel
+}  // namespace fx
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
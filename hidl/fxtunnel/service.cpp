@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.xiaomi.hardware.fx.tunnel@1.1-service.xiaomi"
+
+#include <android-base/logging.h>
+#include <hidl/HidlTransportSupport.h>
+
+#include "MiFxTunnel.h"
+
+using ::vendor::xiaomi::hardware::fx::tunnel::V1_1::implementation::MiFxTunnel;
+
+int main() {
+    android::sp<MiFxTunnel> miFxTunnel = new MiFxTunnel();
+    miFxTunnel->loadDeviceCommands();
+
+    android::hardware::configureRpcThreadpool(4, true);
+
+    if (miFxTunnel->registerAsService() != android::OK) {
+        LOG(ERROR) << "Cannot register MiFxTunnel HAL service.";
+        return 1;
+    }
+
+    LOG(INFO) << "MiFxTunnel HAL service ready.";
+
+    android::hardware::joinRpcThreadpool();
+
+    LOG(ERROR) << "MiFxTunnel HAL service failed to join thread pool.";
+    return 1;
+}
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "MotorService"
+
+#include "Motor.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+#include <sstream>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace motor {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+// A full stroke takes well under a second, anything longer is a jam
+constexpr auto kMoveTimeout = milliseconds(2000);
+
+int32_t movingStatus(MotorDriver::Move move) {
+    switch (move) {
+        case MotorDriver::Move::POPUP:
+            return MOTOR_STATUS_POPPING_UP;
+        case MotorDriver::Move::TAKEBACK:
+        case MotorDriver::Move::TAKEBACK_SHORTLY:
+            return MOTOR_STATUS_TAKING_BACK;
+        case MotorDriver::Move::CALIBRATE:
+            return MOTOR_STATUS_CALIBRATING;
+    }
+    return MOTOR_STATUS_ERROR;
+}
+
+int32_t finalStatus(MotorDriver::Move move) {
+    // Calibration parks the camera
+    return move == MotorDriver::Move::POPUP ? MOTOR_STATUS_POPUP : MOTOR_STATUS_TAKEBACK;
+}
+
+}  // anonymous namespace
+
+Motor::Motor(std::unique_ptr<MotorDriver> driver) : mDriver(std::move(driver)) {
+    // The camera may have been left out by a previous instance of the service
+    switch (mDriver->position()) {
+        case MotorDriver::Position::POPUP:
+            mStatus = MOTOR_STATUS_POPUP;
+            mPositionKnown = true;
+            break;
+        case MotorDriver::Position::TAKEBACK:
+            mStatus = MOTOR_STATUS_TAKEBACK;
+            mPositionKnown = true;
+            break;
+        case MotorDriver::Position::UNKNOWN:
+            LOG(WARNING) << "Motor position unknown, moving on every request until one finishes";
+            break;
+    }
+
+    mWorker = std::thread(&Motor::workerThread, this);
+}
+
+Motor::~Motor() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCv.notify_all();
+    mDriver->interrupt();
+    mWorker.join();
+}
+
+Return<void> Motor::popupMotor(int32_t cookie) {
+    submit(MotorDriver::Move::POPUP, cookie);
+    return {};
+}
+
+Return<void> Motor::takebackMotor(int32_t cookie) {
+    submit(MotorDriver::Move::TAKEBACK, cookie);
+    return {};
+}
+
+Return<void> Motor::setMotorCallback(const sp<IMotorCallback>& motorcallback) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mCallback = motorcallback;
+    return {};
+}
+
+Return<void> Motor::init() {
+    // The driver is opened for the lifetime of the service
+    return {};
+}
+
+Return<void> Motor::release() {
+    return {};
+}
+
+Return<int32_t> Motor::getMotorStatus() {
+    return mStatus.load();
+}
+
+Return<void> Motor::calibration() {
+    submit(MotorDriver::Move::CALIBRATE, 0);
+    return {};
+}
+
+Return<void> Motor::takebackMotorShortly() {
+    submit(MotorDriver::Move::TAKEBACK_SHORTLY, 0);
+    return {};
+}
+
+/*
+ * Requests going the same way as the move in flight (or the one queued) join it instead of
+ * starting another one. A request going the other way cancels whatever is queued and
+ * redirects the move in flight from where the camera currently is.
+ */
+void Motor::submit(MotorDriver::Move move, int32_t cookie) {
+    const auto now = steady_clock::now();
+    std::vector<Notification> notifications;
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+
+        auto sameWay = [move](const Request& request) {
+            return finalStatus(request.move) == finalStatus(move) &&
+                   move != MotorDriver::Move::CALIBRATE &&
+                   request.move != MotorDriver::Move::CALIBRATE;
+        };
+
+        if (mPending && sameWay(*mPending)) {
+            mPending->cookies.push_back(cookie);
+            mJoined++;
+        } else if (!mPending && mActive && sameWay(*mActive)) {
+            mActive->cookies.push_back(cookie);
+            mJoined++;
+        } else if (!mPending && !mActive && move != MotorDriver::Move::CALIBRATE &&
+                   mPositionKnown && mStatus == finalStatus(move)) {
+            notifications.push_back({finalStatus(move), {cookie}});
+            mAlreadyThere++;
+        } else {
+            if (mPending) {
+                notifications.push_back({MOTOR_STATUS_CANCELED, std::move(mPending->cookies)});
+                mCanceled++;
+            }
+            mPending = Request{move, {cookie}, now};
+
+            if (mActive && !sameWay(*mActive)) {
+                mDriver->interrupt();
+            }
+        }
+    }
+
+    mCv.notify_one();
+    notify(notifications);
+}
+
+void Motor::notify(const std::vector<Notification>& notifications) {
+    if (notifications.empty()) {
+        return;
+    }
+
+    sp<IMotorCallback> callback;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        callback = mCallback;
+    }
+    if (callback == nullptr) {
+        return;
+    }
+
+    for (const auto& [value, cookies] : notifications) {
+        for (int32_t cookie : cookies) {
+            auto ret = callback->onNotify({.vaalue = value, .cookie = cookie});
+            if (!ret.isOk()) {
+                LOG(ERROR) << "Failed to notify motor event " << value << " for " << cookie;
+            }
+        }
+    }
+}
+
+void Motor::workerThread() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (true) {
+        mCv.wait(lock, [this] { return mExit || mPending; });
+        if (mExit) {
+            return;
+        }
+
+        mActive = std::move(mPending);
+        mPending.reset();
+        const MotorDriver::Move move = mActive->move;
+        const auto enqueueTime = mActive->enqueueTime;
+        mStatus = movingStatus(move);
+        lock.unlock();
+
+        auto startTime = steady_clock::now();
+        MotorDriver::Result result = MotorDriver::Result::ERROR;
+        if (mDriver->start(move)) {
+            while ((result = mDriver->wait(startTime + kMoveTimeout)) ==
+                   MotorDriver::Result::INTERRUPTED) {
+                // Without a pending request, the interrupt was aimed at the previous move
+                // and arrived after it had finished
+                std::lock_guard<std::mutex> guard(mLock);
+                if (mPending || mExit) {
+                    break;
+                }
+            }
+        }
+        auto now = steady_clock::now();
+
+        lock.lock();
+        std::vector<Notification> notifications;
+        Request active = std::move(*mActive);
+        mActive.reset();
+        mMoves++;
+        mTotalStartLatency += startTime - enqueueTime;
+        mMaxStartLatency = std::max<std::chrono::nanoseconds>(mMaxStartLatency,
+                                                              startTime - enqueueTime);
+
+        switch (result) {
+            case MotorDriver::Result::DONE:
+                mStatus = finalStatus(move);
+                mPositionKnown = true;
+                notifications.push_back({mStatus, std::move(active.cookies)});
+                if (move == MotorDriver::Move::POPUP) {
+                    mPopups++;
+                    mTotalPopupTime += now - enqueueTime;
+                    mMaxPopupTime = std::max<std::chrono::nanoseconds>(mMaxPopupTime,
+                                                                       now - enqueueTime);
+                }
+                break;
+            case MotorDriver::Result::INTERRUPTED:
+                // Redirected by the pending request, which starts from here
+                notifications.push_back({MOTOR_STATUS_CANCELED, std::move(active.cookies)});
+                mCanceled++;
+                break;
+            case MotorDriver::Result::TIMEOUT:
+            case MotorDriver::Result::ERROR:
+                LOG(ERROR) << "Motor move " << static_cast<int>(move) << " failed";
+                mStatus = MOTOR_STATUS_ERROR;
+                notifications.push_back({MOTOR_STATUS_ERROR, std::move(active.cookies)});
+                mFailed++;
+                break;
+        }
+
+        lock.unlock();
+        notify(notifications);
+        lock.lock();
+    }
+}
+
+Return<void> Motor::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* args */) {
+    if (fd == nullptr || fd->numFds < 1) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    std::ostringstream stream;
+    stream << "Motor:" << std::endl;
+    stream << "  Status: " << mStatus << ", active: " << (mActive ? "yes" : "no")
+           << ", pending: " << (mPending ? "yes" : "no") << std::endl;
+    stream << "  Moves: " << mMoves << ", joined: " << mJoined
+           << ", already there: " << mAlreadyThere << ", canceled: " << mCanceled
+           << ", failed: " << mFailed << std::endl;
+
+    if (mMoves > 0) {
+        stream << "  Request to driver latency avg: "
+               << duration_cast<microseconds>(mTotalStartLatency / mMoves).count()
+               << " us, max: " << duration_cast<microseconds>(mMaxStartLatency).count() << " us"
+               << std::endl;
+    }
+
+    if (mPopups > 0) {
+        stream << "  Popup latency avg: "
+               << duration_cast<milliseconds>(mTotalPopupTime / mPopups).count()
+               << " ms, max: " << duration_cast<milliseconds>(mMaxPopupTime).count() << " ms"
+               << std::endl;
+    }
+
+    ::android::base::WriteStringToFd(stream.str(), fd->data[0]);
+    return {};
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace motor
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
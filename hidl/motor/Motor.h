@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <vendor/xiaomi/hardware/motor/1.0/IMotor.h>
+
+#include "MotorDriver.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace motor {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::sp;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+
+// getMotorStatus() results, also sent as MotorEvent values once a move finishes
+enum MotorStatus : int32_t {
+    MOTOR_STATUS_CANCELED = -2,
+    MOTOR_STATUS_ERROR = -1,
+    MOTOR_STATUS_TAKEBACK = 0,
+    MOTOR_STATUS_POPUP = 1,
+    MOTOR_STATUS_POPPING_UP = 2,
+    MOTOR_STATUS_TAKING_BACK = 3,
+    MOTOR_STATUS_CALIBRATING = 4,
+};
+
+class Motor : public IMotor {
+  public:
+    Motor(std::unique_ptr<MotorDriver> driver);
+    ~Motor();
+
+    // Methods from ::vendor::xiaomi::hardware::motor::V1_0::IMotor follow.
+    Return<void> popupMotor(int32_t cookie) override;
+    Return<void> takebackMotor(int32_t cookie) override;
+    Return<void> setMotorCallback(const sp<IMotorCallback>& motorcallback) override;
+    Return<void> init() override;
+    Return<void> release() override;
+    Return<int32_t> getMotorStatus() override;
+    Return<void> calibration() override;
+    Return<void> takebackMotorShortly() override;
+
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
+  private:
+    struct Request {
+        MotorDriver::Move move;
+        // Every caller waiting on this move, redundant requests join the one in flight
+        std::vector<int32_t> cookies;
+        std::chrono::steady_clock::time_point enqueueTime;
+    };
+
+    using Notification = std::pair<int32_t, std::vector<int32_t>>;
+
+    void submit(MotorDriver::Move move, int32_t cookie);
+    void notify(const std::vector<Notification>& notifications);
+    void workerThread();
+
+    std::unique_ptr<MotorDriver> mDriver;
+    std::atomic<int32_t> mStatus = MOTOR_STATUS_TAKEBACK;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    sp<IMotorCallback> mCallback;
+    std::optional<Request> mActive;
+    std::optional<Request> mPending;
+    // Until then a request can't be answered from mStatus without moving
+    bool mPositionKnown = false;
+    bool mExit = false;
+
+    // Statistics, guarded by mLock
+    uint64_t mMoves = 0;
+    uint64_t mJoined = 0;
+    uint64_t mAlreadyThere = 0;
+    uint64_t mCanceled = 0;
+    uint64_t mFailed = 0;
+    uint64_t mPopups = 0;
+    std::chrono::nanoseconds mTotalStartLatency{0};
+    std::chrono::nanoseconds mMaxStartLatency{0};
+    std::chrono::nanoseconds mTotalPopupTime{0};
+    std::chrono::nanoseconds mMaxPopupTime{0};
+
+    std::thread mWorker;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace motor
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
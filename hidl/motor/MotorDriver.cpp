@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "MotorService"
+
+#include "MotorDriver.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <string>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace motor {
+namespace V1_0 {
+namespace implementation {
+
+SysfsMotorDriver::SysfsMotorDriver() {
+    mControlFd.reset(TEMP_FAILURE_RETRY(open(MOTOR_CONTROL_PATH, O_WRONLY | O_CLOEXEC)));
+    if (!mControlFd.ok()) {
+        PLOG(ERROR) << "Failed to open " << MOTOR_CONTROL_PATH;
+    }
+
+    mStateFd.reset(TEMP_FAILURE_RETRY(open(MOTOR_STATE_PATH, O_RDONLY | O_CLOEXEC)));
+    if (!mStateFd.ok()) {
+        PLOG(ERROR) << "Failed to open " << MOTOR_STATE_PATH;
+    }
+
+    mInterruptFd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+}
+
+bool SysfsMotorDriver::readState(int* state) {
+    char buf[16];
+    ssize_t len = TEMP_FAILURE_RETRY(pread(mStateFd.get(), buf, sizeof(buf) - 1, 0));
+    if (len <= 0) {
+        PLOG(ERROR) << "Failed to read " << MOTOR_STATE_PATH;
+        return false;
+    }
+    buf[len] = '\0';
+
+    *state = atoi(buf);
+    return true;
+}
+
+MotorDriver::Position SysfsMotorDriver::position() {
+#ifdef MOTOR_POSITION_PATH
+    std::string value;
+    if (!::android::base::ReadFileToString(MOTOR_POSITION_PATH, &value)) {
+        PLOG(ERROR) << "Failed to read " << MOTOR_POSITION_PATH;
+        return Position::UNKNOWN;
+    }
+
+    value = ::android::base::Trim(value);
+    if (value == "1") {
+        return Position::POPUP;
+    }
+    if (value == "0") {
+        return Position::TAKEBACK;
+    }
+
+    LOG(ERROR) << "Unexpected motor position " << value;
+#endif
+    return Position::UNKNOWN;
+}
+
+bool SysfsMotorDriver::start(Move move) {
+    if (!mControlFd.ok()) {
+        return false;
+    }
+
+    // Pending interrupts are left alone, one may already be aimed at this move
+    std::string command = std::to_string(static_cast<int>(move));
+    if (TEMP_FAILURE_RETRY(pwrite(mControlFd.get(), command.data(), command.size(), 0)) !=
+        static_cast<ssize_t>(command.size())) {
+        PLOG(ERROR) << "Failed to write " << MOTOR_CONTROL_PATH;
+        return false;
+    }
+
+    return true;
+}
+
+MotorDriver::Result SysfsMotorDriver::wait(steady_clock::time_point deadline) {
+    if (!mStateFd.ok()) {
+        return Result::ERROR;
+    }
+
+    while (true) {
+        // Reading also re-arms POLLPRI
+        int state;
+        if (!readState(&state) || state < 0) {
+            return Result::ERROR;
+        }
+        if (state == 0) {
+            return Result::DONE;
+        }
+
+        auto timeout = duration_cast<milliseconds>(deadline - steady_clock::now());
+        if (timeout.count() <= 0) {
+            return Result::TIMEOUT;
+        }
+
+        struct pollfd fds[] = {
+                {.fd = mStateFd.get(), .events = POLLPRI},
+                {.fd = mInterruptFd.get(), .events = POLLIN},
+        };
+        if (TEMP_FAILURE_RETRY(poll(fds, 2, timeout.count())) < 0) {
+            PLOG(ERROR) << "Failed to poll " << MOTOR_STATE_PATH;
+            return Result::ERROR;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            eventfd_t value;
+            eventfd_read(mInterruptFd.get(), &value);
+            return Result::INTERRUPTED;
+        }
+    }
+}
+
+void SysfsMotorDriver::interrupt() {
+    eventfd_write(mInterruptFd.get(), 1);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace motor
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+
+namespace vendor {
+namespace xiaomi {
+namespace hardware {
+namespace motor {
+namespace V1_0 {
+namespace implementation {
+
+class MotorDriver {
+  public:
+    enum class Move {
+        POPUP = 1,
+        TAKEBACK = 2,
+        TAKEBACK_SHORTLY = 3,
+        CALIBRATE = 4,
+    };
+
+    enum class Result {
+        DONE,
+        TIMEOUT,
+        INTERRUPTED,
+        ERROR,
+    };
+
+    enum class Position {
+        UNKNOWN,
+        TAKEBACK,
+        POPUP,
+    };
+
+    virtual ~MotorDriver() = default;
+
+    // Where the camera rests right now, read once at startup.
+    virtual Position position() = 0;
+
+    // Starts a move and returns right away. Starting a move while one is running reverses or
+    // redirects it from the current position.
+    virtual bool start(Move move) = 0;
+    // Blocks until the last started move finishes, the deadline passes or interrupt() is called.
+    // An interrupt() that no wait() has returned for yet is kept, even across start().
+    virtual Result wait(std::chrono::steady_clock::time_point deadline) = 0;
+    virtual void interrupt() = 0;
+};
+
+/*
+ * Motor driver exposing a control node taking a Move and a state node reading 0 when idle,
+ * 1 while moving and a negative value on a fault, which it sysfs_notify()s on every change.
+ * The optional position node reads 1 while the camera is popped up and 0 when it is back in.
+ */
+class SysfsMotorDriver : public MotorDriver {
+  public:
+    SysfsMotorDriver();
+
+    Position position() override;
+    bool start(Move move) override;
+    Result wait(std::chrono::steady_clock::time_point deadline) override;
+    void interrupt() override;
+
+  private:
+    bool readState(int* state);
+
+    ::android::base::unique_fd mControlFd;
+    ::android::base::unique_fd mStateFd;
+    ::android::base::unique_fd mInterruptFd;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace motor
+}  // namespace hardware
+}  // namespace xiaomi
+}  // namespace vendor
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "vendor.xiaomi.hardware.motor@1.0-service.xiaomi"
+
+#include <android-base/logging.h>
+#include <hidl/HidlTransportSupport.h>
+
+#include "Motor.h"
+
+using ::vendor::xiaomi::hardware::motor::V1_0::IMotor;
+using ::vendor::xiaomi::hardware::motor::V1_0::implementation::Motor;
+using ::vendor::xiaomi::hardware::motor::V1_0::implementation::SysfsMotorDriver;
+
+int main() {
+    android::sp<IMotor> motor = new Motor(std::make_unique<SysfsMotorDriver>());
+
+    android::hardware::configureRpcThreadpool(1, true);
+
+    if (motor->registerAsService() != android::OK) {
+        LOG(ERROR) << "Cannot register motor HAL service.";
+        return 1;
+    }
+
+    LOG(INFO) << "Motor HAL service ready.";
+
+    android::hardware::joinRpcThreadpool();
+
+    LOG(ERROR) << "Motor HAL service failed to join thread pool.";
+    return 1;
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "Motor.h"
+
+using ::vendor::xiaomi::hardware::motor::V1_0::IMotorCallback;
+using ::vendor::xiaomi::hardware::motor::V1_0::MotorEvent;
+using ::vendor::xiaomi::hardware::motor::V1_0::implementation::Motor;
+using ::vendor::xiaomi::hardware::motor::V1_0::implementation::MOTOR_STATUS_CANCELED;
+using ::vendor::xiaomi::hardware::motor::V1_0::implementation::MOTOR_STATUS_POPUP;
+using ::vendor::xiaomi::hardware::motor::V1_0::implementation::MOTOR_STATUS_TAKEBACK;
+using ::vendor::xiaomi::hardware::motor::V1_0::implementation::MotorDriver;
+using ::vendor::xiaomi::hardware::motor::V1_0::implementation::SysfsMotorDriver;
+
+using Move = MotorDriver::Move;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace {
+
+constexpr auto kTimeout = milliseconds(2000);
+
+/*
+ * Simulated motor. A move runs until the test finishes it, and start() can be held to widen
+ * the window between the worker taking a request and the driver seeing it.
+ */
+class FakeMotorDriver : public MotorDriver {
+  public:
+    explicit FakeMotorDriver(Position position) : mPosition(position) {}
+
+    Position position() override { return mPosition; }
+
+    bool start(Move move) override {
+        std::unique_lock<std::mutex> lock(mLock);
+        mStarted.push_back(move);
+        mCv.notify_all();
+        mCv.wait(lock, [this] { return !mHoldStart; });
+        return true;
+    }
+
+    Result wait(steady_clock::time_point deadline) override {
+        std::unique_lock<std::mutex> lock(mLock);
+        if (!mCv.wait_until(lock, deadline, [this] { return mInterrupts > 0 || mFinished > 0; })) {
+            return Result::TIMEOUT;
+        }
+        if (mInterrupts > 0) {
+            mInterrupts = 0;
+            return Result::INTERRUPTED;
+        }
+        mFinished--;
+        return Result::DONE;
+    }
+
+    void interrupt() override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mInterrupts++;
+        mCv.notify_all();
+    }
+
+    void holdStart(bool hold) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mHoldStart = hold;
+        mCv.notify_all();
+    }
+
+    void finishMove() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mFinished++;
+        mCv.notify_all();
+    }
+
+    bool waitForStarts(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCv.wait_for(lock, kTimeout, [&] { return mStarted.size() >= count; });
+    }
+
+    std::vector<Move> started() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mStarted;
+    }
+
+  private:
+    const Position mPosition;
+
+    std::mutex mLock;
+    std::condition_variable mCv;
+    std::vector<Move> mStarted;
+    bool mHoldStart = false;
+    int mInterrupts = 0;
+    int mFinished = 0;
+};
+
+class FakeCallback : public IMotorCallback {
+  public:
+    ::android::hardware::Return<void> onNotify(const MotorEvent& event) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEvents[event.cookie] = event.vaalue;
+        mCv.notify_all();
+        return {};
+    }
+
+    // Returns the value reported for the cookie, or INT32_MIN if none arrives in time
+    int32_t waitFor(int32_t cookie) {
+        std::unique_lock<std::mutex> lock(mLock);
+        if (!mCv.wait_for(lock, kTimeout, [&] { return mEvents.count(cookie) > 0; })) {
+            return INT32_MIN;
+        }
+        return mEvents[cookie];
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCv;
+    std::map<int32_t, int32_t> mEvents;
+};
+
+class MotorTest : public ::testing::Test {
+  protected:
+    void start(MotorDriver::Position position) {
+        auto driver = std::make_unique<FakeMotorDriver>(position);
+        mDriver = driver.get();
+        mMotor = ::android::sp<Motor>(new Motor(std::move(driver)));
+        mCallback = ::android::sp<FakeCallback>(new FakeCallback());
+        mMotor->setMotorCallback(mCallback);
+    }
+
+    FakeMotorDriver* mDriver;
+    ::android::sp<Motor> mMotor;
+    ::android::sp<FakeCallback> mCallback;
+};
+
+}  // anonymous namespace
+
+TEST_F(MotorTest, TakebackBeforeTheDriverStartsCancelsThePopup) {
+    start(MotorDriver::Position::TAKEBACK);
+    mDriver->holdStart(true);
+
+    mMotor->popupMotor(1);
+    ASSERT_TRUE(mDriver->waitForStarts(1));
+    // The worker owns the popup, but the driver hasn't taken it yet
+    mMotor->takebackMotor(2);
+    mDriver->holdStart(false);
+
+    EXPECT_EQ(mCallback->waitFor(1), MOTOR_STATUS_CANCELED);
+    ASSERT_TRUE(mDriver->waitForStarts(2));
+    mDriver->finishMove();
+    EXPECT_EQ(mCallback->waitFor(2), MOTOR_STATUS_TAKEBACK);
+    EXPECT_EQ(mDriver->started(), std::vector<Move>({Move::POPUP, Move::TAKEBACK}));
+}
+
+TEST_F(MotorTest, LateInterruptDoesNotCancelTheNextMove) {
+    start(MotorDriver::Position::TAKEBACK);
+
+    mMotor->popupMotor(1);
+    ASSERT_TRUE(mDriver->waitForStarts(1));
+    mDriver->finishMove();
+    ASSERT_EQ(mCallback->waitFor(1), MOTOR_STATUS_POPUP);
+
+    // What a redirect racing with the end of the popup leaves behind
+    mDriver->interrupt();
+
+    mMotor->takebackMotor(2);
+    ASSERT_TRUE(mDriver->waitForStarts(2));
+    mDriver->finishMove();
+    EXPECT_EQ(mCallback->waitFor(2), MOTOR_STATUS_TAKEBACK);
+}
+
+TEST_F(MotorTest, RequestsGoingTheSameWayJoin) {
+    start(MotorDriver::Position::TAKEBACK);
+    mDriver->holdStart(true);
+
+    mMotor->popupMotor(1);
+    ASSERT_TRUE(mDriver->waitForStarts(1));
+    mMotor->popupMotor(2);
+    mDriver->holdStart(false);
+    mDriver->finishMove();
+
+    EXPECT_EQ(mCallback->waitFor(1), MOTOR_STATUS_POPUP);
+    EXPECT_EQ(mCallback->waitFor(2), MOTOR_STATUS_POPUP);
+    EXPECT_EQ(mDriver->started(), std::vector<Move>({Move::POPUP}));
+}
+
+TEST_F(MotorTest, StartsFromThePositionTheDriverReports) {
+    start(MotorDriver::Position::POPUP);
+    EXPECT_EQ(static_cast<int32_t>(mMotor->getMotorStatus()), MOTOR_STATUS_POPUP);
+
+    // Already out, no move needed
+    mMotor->popupMotor(1);
+    EXPECT_EQ(mCallback->waitFor(1), MOTOR_STATUS_POPUP);
+    EXPECT_TRUE(mDriver->started().empty());
+
+    mMotor->takebackMotor(2);
+    ASSERT_TRUE(mDriver->waitForStarts(1));
+    mDriver->finishMove();
+    EXPECT_EQ(mCallback->waitFor(2), MOTOR_STATUS_TAKEBACK);
+}
+
+TEST_F(MotorTest, UnknownPositionAlwaysMoves) {
+    start(MotorDriver::Position::UNKNOWN);
+
+    mMotor->takebackMotor(1);
+    ASSERT_TRUE(mDriver->waitForStarts(1));
+    mDriver->finishMove();
+    EXPECT_EQ(mCallback->waitFor(1), MOTOR_STATUS_TAKEBACK);
+
+    // Known from here on
+    mMotor->takebackMotor(2);
+    EXPECT_EQ(mCallback->waitFor(2), MOTOR_STATUS_TAKEBACK);
+    EXPECT_EQ(mDriver->started().size(), 1u);
+}
+
+class SysfsMotorDriverTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mkdir(::android::base::Dirname(MOTOR_CONTROL_PATH).c_str(), 0755);
+        ASSERT_TRUE(::android::base::WriteStringToFile("", MOTOR_CONTROL_PATH));
+        ASSERT_TRUE(::android::base::WriteStringToFile("1\n", MOTOR_POSITION_PATH));
+        ASSERT_TRUE(::android::base::WriteStringToFile("1\n", MOTOR_STATE_PATH));
+    }
+};
+
+TEST_F(SysfsMotorDriverTest, InterruptBeforeStartIsKept) {
+    SysfsMotorDriver driver;
+
+    driver.interrupt();
+    ASSERT_TRUE(driver.start(Move::POPUP));
+    EXPECT_EQ(driver.wait(steady_clock::now() + kTimeout), MotorDriver::Result::INTERRUPTED);
+
+    std::string control;
+    ASSERT_TRUE(::android::base::ReadFileToString(MOTOR_CONTROL_PATH, &control));
+    EXPECT_EQ(control, "1");
+}
+
+TEST_F(SysfsMotorDriverTest, ReadsPositionAndState) {
+    SysfsMotorDriver driver;
+    EXPECT_EQ(driver.position(), MotorDriver::Position::POPUP);
+
+    ASSERT_TRUE(driver.start(Move::TAKEBACK));
+    EXPECT_EQ(driver.wait(steady_clock::now() + milliseconds(50)), MotorDriver::Result::TIMEOUT);
+
+    ASSERT_TRUE(::android::base::WriteStringToFile("0\n", MOTOR_STATE_PATH));
+    EXPECT_EQ(driver.wait(steady_clock::now() + kTimeout), MotorDriver::Result::DONE);
+}
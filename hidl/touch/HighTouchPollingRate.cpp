@@ -8,7 +8,11 @@
 
 #include "HighTouchPollingRate.h"
 
-#include <fstream>
+#include <android-base/logging.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 namespace vendor {
 namespace lineage {
@@ -16,18 +20,112 @@ namespace touch {
 namespace V1_0 {
 namespace implementation {
 
+HighTouchPollingRate::HighTouchPollingRate() {
+    mExitFd.reset(eventfd(0, EFD_CLOEXEC));
+    if (!mExitFd.ok()) {
+        PLOG(ERROR) << "Failed to create eventfd, state changes made elsewhere won't be seen";
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    openNodeLocked();
+}
+
+/*
+ * Open the node if it isn't yet. The node may not exist until the touch driver has probed, so
+ * this is retried from every call until it succeeds. Once open, the fd is kept for good.
+ */
+bool HighTouchPollingRate::openNodeLocked() {
+    if (mOpened) {
+        return true;
+    }
+
+    mFd.reset(TEMP_FAILURE_RETRY(open(HIGH_TOUCH_POLLING_PATH, O_RDWR | O_CLOEXEC)));
+    if (!mFd.ok()) {
+        PLOG(ERROR) << "Failed to open " << HIGH_TOUCH_POLLING_PATH;
+        return false;
+    }
+
+    refreshState();
+    mOpened = true;
+
+    if (mExitFd.ok()) {
+        mPollThread = std::thread(&HighTouchPollingRate::pollThread, this);
+    }
+    return true;
+}
+
+HighTouchPollingRate::~HighTouchPollingRate() {
+    if (mPollThread.joinable()) {
+        eventfd_write(mExitFd.get(), 1);
+        mPollThread.join();
+    }
+}
+
+/*
+ * Re-read the node into the cache. Reading also re-arms POLLPRI on sysfs attributes.
+ */
+bool HighTouchPollingRate::refreshState() {
+    char buf[16];
+    ssize_t len = TEMP_FAILURE_RETRY(pread(mFd.get(), buf, sizeof(buf) - 1, 0));
+    if (len <= 0) {
+        PLOG(ERROR) << "Failed to read " << HIGH_TOUCH_POLLING_PATH;
+        return false;
+    }
+    buf[len] = '\0';
+
+    mEnabled = atoi(buf) == 1;
+    return true;
+}
+
+/*
+ * Follow changes made outside this service for drivers that sysfs_notify() the node, so that
+ * isEnabled() can always be answered from the cache.
+ */
+void HighTouchPollingRate::pollThread() {
+    while (true) {
+        struct pollfd fds[] = {
+                {.fd = mFd.get(), .events = POLLPRI},
+                {.fd = mExitFd.get(), .events = POLLIN},
+        };
+        if (TEMP_FAILURE_RETRY(poll(fds, 2, -1)) < 0) {
+            PLOG(ERROR) << "Failed to poll " << HIGH_TOUCH_POLLING_PATH;
+            return;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            return;
+        }
+
+        if (fds[0].revents & (POLLPRI | POLLERR)) {
+            if (!refreshState()) {
+                return;
+            }
+        }
+    }
+}
+
 Return<bool> HighTouchPollingRate::isEnabled() {
-    std::ifstream file(HIGH_TOUCH_POLLING_PATH);
-    int enabled;
-    file >> enabled;
+    if (!mOpened) {
+        std::lock_guard<std::mutex> lock(mLock);
+        openNodeLocked();
+    }
 
-    return enabled == 1;
+    return mEnabled;
 }
 
 Return<bool> HighTouchPollingRate::setEnabled(bool enabled) {
-    std::ofstream file(HIGH_TOUCH_POLLING_PATH);
-    file << (enabled ? "1" : "0");
-    return !file.fail();
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!openNodeLocked()) {
+        return false;
+    }
+
+    if (TEMP_FAILURE_RETRY(pwrite(mFd.get(), enabled ? "1" : "0", 1, 0)) != 1) {
+        PLOG(ERROR) << "Failed to write " << HIGH_TOUCH_POLLING_PATH;
+        return false;
+    }
+
+    mEnabled = enabled;
+    return true;
 }
 
 }  // namespace implementation
@@ -6,8 +6,13 @@
 
 #pragma once
 
+#include <android-base/unique_fd.h>
 #include <vendor/lineage/touch/1.0/IHighTouchPollingRate.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 namespace vendor {
 namespace lineage {
 namespace touch {
@@ -18,9 +23,27 @@ using ::android::hardware::Return;
 
 class HighTouchPollingRate : public IHighTouchPollingRate {
   public:
+    HighTouchPollingRate();
+    ~HighTouchPollingRate();
+
     // Methods from ::vendor::lineage::touch::V1_0::IHighTouchPollingRate follow.
     Return<bool> isEnabled() override;
     Return<bool> setEnabled(bool enabled) override;
+
+  private:
+    bool openNodeLocked();
+    bool refreshState();
+    void pollThread();
+
+    // Guards opening mFd and writes to it
+    std::mutex mLock;
+    ::android::base::unique_fd mFd;
+    // Set once mFd is open, after which it never changes
+    std::atomic<bool> mOpened = false;
+    // Wakes pollThread() up on destruction
+    ::android::base::unique_fd mExitFd;
+    std::atomic<bool> mEnabled = false;
+    std::thread mPollThread;
 };
 
 }  // namespace implementation
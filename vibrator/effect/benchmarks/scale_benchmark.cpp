@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "scale.h"
+
+namespace {
+
+// Play rates of the effect files and of the common fifo drivers
+const uint32_t kEffectRateHz = 24000;
+const uint32_t kDeviceRateHz = 48000;
+
+std::vector<int8_t> makeSamples(size_t length) {
+    std::vector<int8_t> samples(length);
+    for (size_t i = 0; i < length; i++) {
+        samples[i] = static_cast<int8_t>(i * 7 + 3);
+    }
+    return samples;
+}
+
+// The per-sample loop scaleFifoData falls back to, kept from being auto-vectorized
+__attribute__((noinline)) void scaleScalar(const int8_t* in, int8_t* out, size_t length,
+                                           int16_t gain) {
+#if defined(__clang__)
+#pragma clang loop vectorize(disable) interleave(disable)
+#endif
+    for (size_t i = 0; i < length; i++) {
+        int32_t scaled = (in[i] * gain + (1 << 6)) >> 7;
+        out[i] = static_cast<int8_t>(std::clamp(scaled, -128, 127));
+    }
+}
+
+void BM_ScaleScalar(benchmark::State& state) {
+    const std::vector<int8_t> in = makeSamples(state.range(0));
+    std::vector<int8_t> out(in.size());
+
+    for (auto _ : state) {
+        scaleScalar(in.data(), out.data(), in.size(), amplitudeToGain(0.7f));
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_ScaleScalar)->RangeMultiplier(4)->Range(64, 64 * 1024);
+
+void BM_ScaleVector(benchmark::State& state) {
+    const std::vector<int8_t> in = makeSamples(state.range(0));
+    std::vector<int8_t> out(in.size());
+
+    for (auto _ : state) {
+        scaleFifoData(in.data(), out.data(), in.size(), amplitudeToGain(0.7f));
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_ScaleVector)->RangeMultiplier(4)->Range(64, 64 * 1024);
+
+// Resampling has no vector path yet, this is its baseline
+void BM_Resample(benchmark::State& state) {
+    const std::vector<int8_t> in = makeSamples(state.range(0));
+    std::vector<int8_t> out(resampledLength(in.size(), kEffectRateHz, kDeviceRateHz));
+
+    for (auto _ : state) {
+        resampleFifoData(in.data(), in.size(), kEffectRateHz, out.data(), kDeviceRateHz);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_Resample)->RangeMultiplier(4)->Range(64, 64 * 1024);
+
+}  // namespace
+
+BENCHMARK_MAIN();
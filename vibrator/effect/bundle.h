@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Single file holding every effect, so that the library maps one file instead of opening
+ * one per effect. All fields are little endian. The file is laid out as:
+ *
+ *   effect_bundle_header
+ *   effect_bundle_entry[count], sorted by effect_id
+ *   sample data, referenced by offset from the start of the file
+ */
+
+#define EFFECT_BUNDLE_MAGIC 0x42584656  // "VFXB"
+#define EFFECT_BUNDLE_VERSION 1
+
+/*
+ * Samples are stored as-is and are played straight from the mapping. It is the only encoding:
+ * anything compressed would have to be decoded into the fifo pool that compositions share.
+ */
+#define EFFECT_BUNDLE_ENCODING_RAW 0
+
+struct effect_bundle_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t count;
+    uint32_t entry_size;
+};
+
+struct effect_bundle_entry {
+    // Same as the id passed to get_effect_stream, primitives have bit 15 set
+    uint32_t effect_id;
+    uint32_t play_rate_hz;
+    uint32_t encoding;
+    uint32_t offset;
+    // Number of samples once decoded
+    uint32_t length;
+    // Number of bytes stored at offset
+    uint32_t encoded_length;
+};
+
+static_assert(sizeof(effect_bundle_header) == 16, "effect_bundle_header layout changed");
+static_assert(sizeof(effect_bundle_entry) == 24, "effect_bundle_entry layout changed");
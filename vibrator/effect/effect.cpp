@@ -36,94 +36,697 @@
 
 #include <aidl/android/hardware/vibrator/Effect.h>
 #include <android-base/logging.h>
-#include <filesystem>
-#include <fstream>
-#include <iostream>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
+#include "bundle.h"
 #include "effect.h"
+#include "scale.h"
 
 using aidl::android::hardware::vibrator::Effect;
+using android::base::ConsumePrefix;
+using android::base::ConsumeSuffix;
+using android::base::ParseUint;
+using android::base::unique_fd;
 
 namespace {
 
 const uint32_t kDefaultPlayRateHz = 24000;
 const uint16_t kPrimitiveMask = (1 << 15);
+#ifndef VIBRATOR_EFFECT_DIR
+#define VIBRATOR_EFFECT_DIR "/vendor/etc/vibrator"
+#endif
 
-std::unordered_map<uint32_t, effect_stream> sEffectStreams;
-std::unordered_map<uint32_t, std::vector<int8_t>> sEffectFifoData;
+const char kEffectDir[] = VIBRATOR_EFFECT_DIR;
+const char kEffectBundle[] = VIBRATOR_EFFECT_DIR "/effects.bundle";
+
+struct EffectIndexEntry {
+    uint32_t uniqueEffectId;
+    effect_stream stream;
+};
+
+// Immutable once published, entries are sorted by uniqueEffectId
+struct EffectIndex {
+    std::vector<EffectIndexEntry> entries;
+};
+
+/*
+ * Readers only ever do an acquire load of sEffectIndex and a binary search, so lookups are
+ * wait-free. Writers copy the current index under sPublishMutex, add to the copy and publish
+ * it. Superseded indexes are retired rather than freed because callers may still hold
+ * effect_stream pointers into them.
+ */
+std::atomic<const EffectIndex*> sEffectIndex{nullptr};
+std::mutex sPublishMutex;
+std::vector<std::unique_ptr<const EffectIndex>> sRetiredIndexes;
+std::once_flag sPrewarmFlag;
+
+const size_t kFifoPoolBlockSize = 64 * 1024;
+const size_t kFifoPoolMaxSize = 2 * 1024 * 1024;
+const size_t kMaxComposedEffects = 128;
+
+// One step of a composition: silence for delaySamples, then the scaled effect
+struct CompositionSegment {
+    uint32_t uniqueEffectId;
+    uint32_t delaySamples;
+    float scale;
+
+    bool operator==(const CompositionSegment& other) const {
+        return uniqueEffectId == other.uniqueEffectId && delaySamples == other.delaySamples &&
+               scale == other.scale;
+    }
+};
+
+/*
+ * Bump allocator backing all synthesized fifo data. Composed streams are cached for the
+ * lifetime of the process, so blocks are never freed and the total size is capped instead.
+ */
+class FifoPool {
+  public:
+    int8_t* allocate(size_t length) {
+        if (length > kFifoPoolBlockSize) {
+            if (mTotalSize + length > kFifoPoolMaxSize) {
+                return nullptr;
+            }
+            mTotalSize += length;
+            return newBlock(length);
+        }
+
+        if (!mCurrentBlock || mCurrentBlockUsed + length > kFifoPoolBlockSize) {
+            if (mTotalSize + kFifoPoolBlockSize > kFifoPoolMaxSize) {
+                return nullptr;
+            }
+            mTotalSize += kFifoPoolBlockSize;
+            mCurrentBlock = newBlock(kFifoPoolBlockSize);
+            mCurrentBlockUsed = 0;
+        }
+
+        int8_t* data = mCurrentBlock + mCurrentBlockUsed;
+        mCurrentBlockUsed += length;
+        return data;
+    }
+
+  private:
+    int8_t* newBlock(size_t size) {
+        mBlocks.emplace_back(new int8_t[size]);
+        return mBlocks.back().get();
+    }
+
+    std::vector<std::unique_ptr<int8_t[]>> mBlocks;
+    int8_t* mCurrentBlock = nullptr;
+    size_t mCurrentBlockUsed = 0;
+    size_t mTotalSize = 0;
+};
+
+struct ComposedEffect {
+    std::vector<CompositionSegment> segments;
+    effect_stream stream;
+};
+
+const size_t kMaxScaledEffects = 64;
+const size_t kMaxScaledEffectsSize = 1024 * 1024;
+
+// Effect id, gain and play rate
+using ScaledEffectKey = std::tuple<uint32_t, int16_t, uint32_t>;
+
+struct ScaledEffect {
+    std::vector<int8_t> fifoData;
+    effect_stream stream;
+};
+
+/*
+ * Scaled streams are handed out without a reference count, so like composed streams they are
+ * never freed and the cache is capped instead. Guarded by sScaleMutex.
+ */
+std::mutex sScaleMutex;
+std::map<ScaledEffectKey, ScaledEffect> sScaledEffects;
+size_t sScaledEffectsSize = 0;
+
+// Guards sFifoPool and sComposedEffects
+std::mutex sComposeMutex;
+FifoPool sFifoPool;
+std::unordered_map<uint64_t, ComposedEffect> sComposedEffects;
+
+/*
+ * Map an effect file read-only. The mapping is never torn down since the returned
+ * effect streams point straight into it for the lifetime of the process, and the
+ * pages are shared with every other user of the file through the page cache.
+ */
+const int8_t* mapEffectFile(const std::string& filePath, uint32_t* length) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(filePath.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd.get(), &st) < 0) {
+        PLOG(ERROR) << "Failed to stat " << filePath;
+        return nullptr;
+    }
+
+    if (st.st_size <= 0 || st.st_size > UINT32_MAX) {
+        LOG(ERROR) << "Invalid size " << st.st_size << " for " << filePath;
+        return nullptr;
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (addr == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to mmap " << filePath;
+        return nullptr;
+    }
+
+    // Fault the pages in now rather than on the first play
+    madvise(addr, st.st_size, MADV_WILLNEED);
+
+    *length = static_cast<uint32_t>(st.st_size);
+    return static_cast<const int8_t*>(addr);
+}
 
 std::unique_ptr<effect_stream> readEffectStreamFromFile(uint32_t uniqueEffectId) {
-    std::filesystem::path filePath;
+    std::string filePath;
 
     uint32_t effectId = uniqueEffectId & ~kPrimitiveMask;
 
     if ((uniqueEffectId & kPrimitiveMask) != 0) {
-        filePath = "/vendor/etc/vibrator/primitive_effect_" + std::to_string(effectId) + ".bin";
+        filePath = std::string(kEffectDir) + "/primitive_effect_" + std::to_string(effectId) +
+                   ".bin";
     } else {
-        filePath = "/vendor/etc/vibrator/effect_" + std::to_string(effectId) + ".bin";
+        filePath = std::string(kEffectDir) + "/effect_" + std::to_string(effectId) + ".bin";
     }
 
-    LOG(VERBOSE) << "Reading fifo data for effect " << effectId << " from " << filePath;
+    LOG(VERBOSE) << "Mapping fifo data for effect " << effectId << " from " << filePath;
 
-    std::ifstream data(filePath, std::ios::in | std::ios::binary);
-    if (!data.is_open()) {
-        LOG(ERROR) << "Failed to open " << filePath << " for effect " << effectId;
+    uint32_t length;
+    const int8_t* data = mapEffectFile(filePath, &length);
+    if (!data) {
+        LOG(ERROR) << "Failed to map " << filePath << " for effect " << effectId;
         return nullptr;
     }
 
-    std::uint32_t fileSize = std::filesystem::file_size(filePath);
+    return std::make_unique<effect_stream>(effectId, length, kDefaultPlayRateHz, data);
+}
 
-    std::vector<int8_t> fifoData(fileSize);
-    data.read(reinterpret_cast<char*>(fifoData.data()), fileSize);
+/*
+ * Parse effect_<id>.bin and primitive_effect_<id>.bin into the unique effect id used for
+ * lookups, where primitives have kPrimitiveMask set.
+ */
+bool parseEffectFileName(std::string_view name, uint32_t* uniqueEffectId) {
+    uint32_t mask = 0;
 
-    auto result = sEffectFifoData.emplace(uniqueEffectId, std::move(fifoData));
+    if (ConsumePrefix(&name, "primitive_effect_")) {
+        mask = kPrimitiveMask;
+    } else if (!ConsumePrefix(&name, "effect_")) {
+        return false;
+    }
 
-    return std::make_unique<effect_stream>(effectId, fileSize, kDefaultPlayRateHz,
-                                           result.first->second.data());
+    if (!ConsumeSuffix(&name, ".bin")) {
+        return false;
+    }
+
+    uint32_t effectId;
+    if (!ParseUint(std::string(name), &effectId, static_cast<uint32_t>(kPrimitiveMask - 1))) {
+        return false;
+    }
+
+    *uniqueEffectId = effectId | mask;
+    return true;
+}
+
+bool compareEntries(const EffectIndexEntry& a, const EffectIndexEntry& b) {
+    return a.uniqueEffectId < b.uniqueEffectId;
+}
+
+const effect_stream* findEffectStream(const EffectIndex* index, uint32_t uniqueEffectId) {
+    auto it = std::lower_bound(index->entries.begin(), index->entries.end(), uniqueEffectId,
+                               [](const EffectIndexEntry& entry, uint32_t id) {
+                                   return entry.uniqueEffectId < id;
+                               });
+    if (it == index->entries.end() || it->uniqueEffectId != uniqueEffectId) {
+        return nullptr;
+    }
+
+    return &it->stream;
+}
+
+// Must be called with sPublishMutex held
+void publishIndexLocked(std::unique_ptr<EffectIndex> index) {
+    const EffectIndex* previous = sEffectIndex.exchange(index.release(), std::memory_order_acq_rel);
+    if (previous) {
+        sRetiredIndexes.emplace_back(previous);
+    }
+}
+
+/*
+ * Add an effect after the initial scan. Returns the stream that ends up in the index,
+ * which is the existing one if another thread published the same id first.
+ */
+const effect_stream* publishEffectStream(uint32_t uniqueEffectId, const effect_stream& stream) {
+    std::lock_guard<std::mutex> lock(sPublishMutex);
+
+    const EffectIndex* current = sEffectIndex.load(std::memory_order_acquire);
+    auto index = std::make_unique<EffectIndex>();
+    if (current) {
+        if (const effect_stream* existing = findEffectStream(current, uniqueEffectId)) {
+            return existing;
+        }
+        index->entries.reserve(current->entries.size() + 1);
+        index->entries.assign(current->entries.begin(), current->entries.end());
+    }
+
+    EffectIndexEntry entry{uniqueEffectId, stream};
+    index->entries.insert(std::upper_bound(index->entries.begin(), index->entries.end(), entry,
+                                           compareEntries),
+                          entry);
+
+    const EffectIndex* published = index.get();
+    publishIndexLocked(std::move(index));
+
+    return findEffectStream(published, uniqueEffectId);
+}
+
+uint64_t hashComposition(const std::vector<CompositionSegment>& segments) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+    };
+
+    for (const CompositionSegment& segment : segments) {
+        uint32_t scaleBits;
+        memcpy(&scaleBits, &segment.scale, sizeof(scaleBits));
+
+        mix(segment.uniqueEffectId);
+        mix(segment.delaySamples);
+        mix(scaleBits);
+    }
+
+    return hash;
 }
 
-std::unique_ptr<effect_stream> duplicateEffect(const effect_stream* effectStream,
-                                               uint32_t newEffectId) {
-    const std::uint32_t newEffectLength = effectStream->length * 4;
-    std::vector<int8_t> fifoData(newEffectLength);
+/*
+ * Look up the sources of a composition and the length of its fifo data, so that it can be
+ * written into a buffer of the right size.
+ */
+bool resolveComposition(const EffectIndex* index, const std::vector<CompositionSegment>& segments,
+                        uint32_t playRateHz, std::vector<const effect_stream*>* sources,
+                        uint32_t* length) {
+    uint64_t totalLength = 0;
+
+    sources->clear();
+    for (const CompositionSegment& segment : segments) {
+        const effect_stream* source = findEffectStream(index, segment.uniqueEffectId);
+        if (!source) {
+            LOG(ERROR) << "Missing effect " << (segment.uniqueEffectId & ~kPrimitiveMask)
+                       << " for composition";
+            return false;
+        }
 
-    std::copy(effectStream->data, effectStream->data + effectStream->length, fifoData.begin());
-    std::copy(effectStream->data, effectStream->data + effectStream->length,
-              fifoData.begin() + newEffectLength - effectStream->length);
+        sources->push_back(source);
+        totalLength += segment.delaySamples;
+        totalLength += source->play_rate_hz == playRateHz
+                               ? source->length
+                               : resampledLength(source->length, source->play_rate_hz, playRateHz);
+    }
 
-    auto result = sEffectFifoData.emplace(newEffectId, std::move(fifoData));
+    if (totalLength == 0 || totalLength > UINT32_MAX) {
+        LOG(ERROR) << "Invalid composition length " << totalLength;
+        return false;
+    }
 
-    return std::make_unique<effect_stream>(newEffectId, newEffectLength, kDefaultPlayRateHz,
-                                           result.first->second.data());
+    *length = static_cast<uint32_t>(totalLength);
+    return true;
 }
 
+// Write the fifo data for a resolved composition in a single pass, resampling to playRateHz
+void renderComposition(const std::vector<CompositionSegment>& segments,
+                       const std::vector<const effect_stream*>& sources, uint32_t playRateHz,
+                       int8_t* out) {
+    for (size_t i = 0; i < segments.size(); i++) {
+        const CompositionSegment& segment = segments[i];
+        const effect_stream* source = sources[i];
+
+        memset(out, 0, segment.delaySamples);
+        out += segment.delaySamples;
+
+        const int16_t gain = amplitudeToGain(segment.scale);
+        size_t length = source->length;
+        if (source->play_rate_hz != playRateHz) {
+            length = resampledLength(source->length, source->play_rate_hz, playRateHz);
+            resampleFifoData(source->data, source->length, source->play_rate_hz, out,
+                             playRateHz);
+            if (gain != kUnityGain) {
+                scaleFifoData(out, out, length, gain);
+            }
+        } else if (gain == kUnityGain) {
+            memcpy(out, source->data, length);
+        } else {
+            scaleFifoData(source->data, out, length, gain);
+        }
+        out += length;
+    }
+}
+
+/*
+ * Build the fifo data for a sequence of effects into one pooled buffer. Returns NULL if a
+ * source is missing or the pool is exhausted. Must be called with sComposeMutex held.
+ */
+std::unique_ptr<effect_stream> composeEffectStreamLocked(
+        const EffectIndex* index, const std::vector<CompositionSegment>& segments,
+        uint32_t newEffectId, uint32_t playRateHz) {
+    std::vector<const effect_stream*> sources;
+    uint32_t length;
+    if (!resolveComposition(index, segments, playRateHz, &sources, &length)) {
+        return nullptr;
+    }
+
+    int8_t* data = sFifoPool.allocate(length);
+    if (!data) {
+        LOG(VERBOSE) << "Fifo pool exhausted, cannot cache " << length << " samples";
+        return nullptr;
+    }
+
+    renderComposition(segments, sources, playRateHz, data);
+    return std::make_unique<effect_stream>(newEffectId, length, playRateHz, data);
+}
+
+/*
+ * Map the effect bundle once and add every valid entry to entries. Entries point into the
+ * mapping, so they take no fifo pool memory away from compositions.
+ */
+void loadEffectBundle(std::vector<EffectIndexEntry>* entries) {
+    uint32_t size;
+    const int8_t* base = mapEffectFile(kEffectBundle, &size);
+    if (!base) {
+        LOG(VERBOSE) << "No effect bundle at " << kEffectBundle << ", using loose files";
+        return;
+    }
+
+    effect_bundle_header header;
+    if (size < sizeof(header)) {
+        LOG(ERROR) << "Truncated effect bundle " << kEffectBundle;
+        return;
+    }
+    memcpy(&header, base, sizeof(header));
+
+    if (header.magic != EFFECT_BUNDLE_MAGIC || header.version != EFFECT_BUNDLE_VERSION ||
+        header.header_size < sizeof(header) || header.entry_size < sizeof(effect_bundle_entry) ||
+        header.header_size + (uint64_t)header.count * header.entry_size > size) {
+        LOG(ERROR) << "Invalid effect bundle " << kEffectBundle;
+        return;
+    }
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        effect_bundle_entry entry;
+        memcpy(&entry, base + header.header_size + (uint64_t)i * header.entry_size, sizeof(entry));
+
+        if (entry.length == 0 || entry.play_rate_hz == 0 ||
+            (uint64_t)entry.offset + entry.encoded_length > size) {
+            LOG(ERROR) << "Invalid bundle entry for effect " << entry.effect_id;
+            continue;
+        }
+
+        if (entry.encoding != EFFECT_BUNDLE_ENCODING_RAW || entry.encoded_length != entry.length) {
+            LOG(ERROR) << "Cannot load bundle entry for effect " << entry.effect_id
+                       << " with encoding " << entry.encoding;
+            continue;
+        }
+        const int8_t* data = base + entry.offset;
+
+        entries->push_back({entry.effect_id,
+                            effect_stream(entry.effect_id & ~kPrimitiveMask, entry.length,
+                                          entry.play_rate_hz, data)});
+    }
+}
+
+/*
+ * Scan the effect directory once and build the sorted index, so that get_effect_stream
+ * never has to touch the filesystem.
+ */
+void prewarmEffectStreams() {
+    auto index = std::make_unique<EffectIndex>();
+
+    loadEffectBundle(&index->entries);
+    std::sort(index->entries.begin(), index->entries.end(), compareEntries);
+    index->entries.erase(std::unique(index->entries.begin(), index->entries.end(),
+                                     [](const EffectIndexEntry& a, const EffectIndexEntry& b) {
+                                         return a.uniqueEffectId == b.uniqueEffectId;
+                                     }),
+                         index->entries.end());
+    const size_t numBundled = index->entries.size();
+
+    // Loose files only fill in effects that are missing from the bundle
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(kEffectDir), closedir);
+    if (!dir) {
+        PLOG(ERROR) << "Failed to open " << kEffectDir;
+    } else {
+        while (struct dirent* entry = readdir(dir.get())) {
+            uint32_t uniqueEffectId;
+            if (!parseEffectFileName(entry->d_name, &uniqueEffectId)) {
+                continue;
+            }
+
+            auto bundled = std::lower_bound(index->entries.begin(),
+                                            index->entries.begin() + numBundled,
+                                            EffectIndexEntry{uniqueEffectId, {0, 0, 0, nullptr}},
+                                            compareEntries);
+            if (bundled != index->entries.begin() + numBundled &&
+                bundled->uniqueEffectId == uniqueEffectId) {
+                continue;
+            }
+
+            std::unique_ptr<effect_stream> effectStream =
+                    readEffectStreamFromFile(uniqueEffectId);
+            if (effectStream) {
+                index->entries.push_back({uniqueEffectId, *effectStream});
+            }
+        }
+    }
+
+    std::sort(index->entries.begin(), index->entries.end(), compareEntries);
+    LOG(INFO) << "Prewarmed " << index->entries.size() << " effects from " << kEffectDir << ", "
+              << numBundled << " of them bundled";
+
+    const effect_stream* clickStream = findEffectStream(index.get(), (uint32_t)Effect::CLICK);
+    const bool needsDoubleClick =
+            clickStream && !findEffectStream(index.get(), (uint32_t)Effect::DOUBLE_CLICK);
+
+    {
+        std::lock_guard<std::mutex> lock(sPublishMutex);
+        publishIndexLocked(std::move(index));
+    }
+
+    if (needsDoubleClick) {
+        LOG(VERBOSE) << "Could not get double click effect, composing it from click effect";
+        // Two clicks, with the second one ending four click lengths after the first starts
+        const std::vector<CompositionSegment> segments = {
+                {(uint32_t)Effect::CLICK, 0, 1.0f},
+                {(uint32_t)Effect::CLICK, clickStream->length * 2, 1.0f},
+        };
+
+        std::unique_ptr<effect_stream> doubleClickStream;
+        {
+            std::lock_guard<std::mutex> lock(sComposeMutex);
+            doubleClickStream =
+                    composeEffectStreamLocked(sEffectIndex.load(), segments,
+                                              (uint32_t)Effect::DOUBLE_CLICK,
+                                              clickStream->play_rate_hz);
+        }
+        if (doubleClickStream) {
+            publishEffectStream((uint32_t)Effect::DOUBLE_CLICK, *doubleClickStream);
+        }
+    }
+}
+
+const EffectIndex* getEffectIndex() {
+    const EffectIndex* index = sEffectIndex.load(std::memory_order_acquire);
+    if (!index) {
+        // Only reachable if the load-time prewarm did not run
+        std::call_once(sPrewarmFlag, prewarmEffectStreams);
+        index = sEffectIndex.load(std::memory_order_acquire);
+    }
+
+    return index;
+}
+
+/*
+ * Build the index when the library is loaded by the vibrator HAL, ahead of the first effect.
+ * This has to stay below every other global so that they are initialized by then.
+ */
+[[maybe_unused]] const bool sPrewarmed = [] {
+    std::call_once(sPrewarmFlag, prewarmEffectStreams);
+    return true;
+}();
+
 }  // namespace
 
 const struct effect_stream* get_effect_stream(uint32_t effectId) {
-    auto it = sEffectStreams.find(effectId);
-    if (it == sEffectStreams.end()) {
-        std::unique_ptr<effect_stream> newEffectStream = readEffectStreamFromFile(effectId);
-
-        if (newEffectStream) {
-            auto result = sEffectStreams.emplace(effectId, *newEffectStream);
-            return &result.first->second;
-        } else if (effectId == (uint32_t)Effect::DOUBLE_CLICK) {
-            LOG(VERBOSE) << "Could not get double click effect, duplicating click effect";
-            newEffectStream = duplicateEffect(get_effect_stream((uint32_t)Effect::CLICK),
-                                              (uint32_t)Effect::DOUBLE_CLICK);
-            if (newEffectStream) {
-                auto result = sEffectStreams.emplace(effectId, *newEffectStream);
-                return &result.first->second;
+    const EffectIndex* index = getEffectIndex();
+
+    const effect_stream* effectStream = findEffectStream(index, effectId);
+    if (!effectStream && effectId != (uint32_t)Effect::CLICK) {
+        LOG(VERBOSE) << "Could not get effect " << effectId << ", falling back to click effect";
+        effectStream = findEffectStream(index, (uint32_t)Effect::CLICK);
+    }
+
+    return effectStream;
+}
+
+const struct effect_stream* get_composed_effect_stream(const struct effect_primitive* primitives,
+                                                       size_t count,
+                                                       struct effect_stream_storage* storage) {
+    if (!primitives || count == 0) {
+        return nullptr;
+    }
+
+    const EffectIndex* index = getEffectIndex();
+
+    // Delays are counted at the play rate of the first primitive, which the rest follow
+    const uint32_t newEffectId = primitives[0].primitive_id | kPrimitiveMask;
+    const effect_stream* first = findEffectStream(index, newEffectId);
+    if (!first) {
+        LOG(ERROR) << "Missing primitive " << primitives[0].primitive_id << " for composition";
+        return nullptr;
+    }
+    const uint32_t playRateHz = first->play_rate_hz;
+
+    std::vector<CompositionSegment> segments;
+    segments.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const effect_primitive& primitive = primitives[i];
+        if (primitive.primitive_id >= kPrimitiveMask || !(primitive.scale >= 0.0f) ||
+            primitive.scale > 1.0f) {
+            LOG(ERROR) << "Invalid primitive " << primitive.primitive_id << " with scale "
+                       << primitive.scale;
+            return nullptr;
+        }
+
+        const uint64_t delaySamples = (uint64_t)primitive.delay_ms * playRateHz / 1000;
+        segments.push_back({primitive.primitive_id | kPrimitiveMask,
+                            static_cast<uint32_t>(std::min<uint64_t>(delaySamples, UINT32_MAX)),
+                            primitive.scale});
+    }
+
+    const uint64_t hash = hashComposition(segments);
+
+    {
+        std::lock_guard<std::mutex> lock(sComposeMutex);
+
+        auto it = sComposedEffects.find(hash);
+        if (it != sComposedEffects.end() && it->second.segments == segments) {
+            return &it->second.stream;
+        }
+
+        if (it == sComposedEffects.end() && sComposedEffects.size() < kMaxComposedEffects) {
+            std::unique_ptr<effect_stream> composedStream =
+                    composeEffectStreamLocked(index, segments, newEffectId, playRateHz);
+            if (composedStream) {
+                auto result =
+                        sComposedEffects.emplace(hash, ComposedEffect{segments, *composedStream});
+                return &result.first->second.stream;
             }
-        } else if (effectId != (uint32_t)Effect::CLICK) {
-            LOG(VERBOSE) << "Could not get effect " << effectId << ", falling back to click effect";
-            return get_effect_stream((uint32_t)Effect::CLICK);
         }
+    }
+
+    // The cache is full, out of pool space or the hash collided, so compose without it
+    if (!storage) {
+        return nullptr;
+    }
+
+    std::vector<const effect_stream*> sources;
+    uint32_t length;
+    if (!resolveComposition(index, segments, playRateHz, &sources, &length)) {
+        return nullptr;
+    }
+
+    storage->data.resize(length);
+    renderComposition(segments, sources, playRateHz, storage->data.data());
+    storage->stream = effect_stream(newEffectId, length, playRateHz, storage->data.data());
+    return &storage->stream;
+}
+
+const struct effect_stream* get_scaled_effect_stream(uint32_t effectId, float amplitude,
+                                                     uint32_t playRateHz,
+                                                     struct effect_stream_storage* storage) {
+    const effect_stream* source = get_effect_stream(effectId);
+    if (!source || playRateHz == 0) {
+        return nullptr;
+    }
+
+    const int16_t gain = amplitudeToGain(amplitude);
+    if (gain == kUnityGain && playRateHz == source->play_rate_hz) {
+        return source;
+    }
+
+    const ScaledEffectKey key{effectId, gain, playRateHz};
+    {
+        std::lock_guard<std::mutex> lock(sScaleMutex);
+        auto it = sScaledEffects.find(key);
+        if (it != sScaledEffects.end()) {
+            return &it->second.stream;
+        }
+    }
+
+    std::vector<int8_t> fifoData;
+    if (playRateHz != source->play_rate_hz) {
+        fifoData.resize(resampledLength(source->length, source->play_rate_hz, playRateHz));
+        resampleFifoData(source->data, source->length, source->play_rate_hz, fifoData.data(),
+                         playRateHz);
+        scaleFifoData(fifoData.data(), fifoData.data(), fifoData.size(), gain);
     } else {
-        return &it->second;
+        fifoData.resize(source->length);
+        scaleFifoData(source->data, fifoData.data(), fifoData.size(), gain);
+    }
+
+    if (fifoData.empty() || fifoData.size() > UINT32_MAX) {
+        return nullptr;
+    }
+
+    const uint32_t length = static_cast<uint32_t>(fifoData.size());
+    {
+        std::lock_guard<std::mutex> lock(sScaleMutex);
+
+        // Another thread may have scaled the same effect meanwhile
+        auto it = sScaledEffects.find(key);
+        if (it != sScaledEffects.end()) {
+            return &it->second.stream;
+        }
+
+        if (sScaledEffects.size() < kMaxScaledEffects &&
+            sScaledEffectsSize + length <= kMaxScaledEffectsSize) {
+            const int8_t* data = fifoData.data();
+            sScaledEffectsSize += length;
+            auto result = sScaledEffects.emplace(
+                    key, ScaledEffect{std::move(fifoData),
+                                      effect_stream(source->effect_id, length, playRateHz, data)});
+            return &result.first->second.stream;
+        }
+    }
+
+    // The cache is full, so hand the result to the caller instead
+    if (!storage) {
+        return nullptr;
     }
 
-    return nullptr;
+    storage->data = std::move(fifoData);
+    storage->stream = effect_stream(source->effect_id, length, playRateHz, storage->data.data());
+    return &storage->stream;
 }
@@ -32,6 +32,8 @@
 #define QTI_VIBRATOR_EFFECT_STREAM_H
 #include <sys/types.h>
 
+#include <vector>
+
 struct effect_stream {
     uint32_t effect_id;
     uint32_t length;
@@ -42,6 +44,41 @@ struct effect_stream {
         : effect_id(effect_id), length(length), play_rate_hz(play_rate_hz), data(data) {}
 };
 
+/*
+ * Caller owned backing for a stream that could not be cached. A stream returned through it
+ * stays valid until the storage is destroyed or passed to another call.
+ */
+struct effect_stream_storage {
+    std::vector<int8_t> data;
+    effect_stream stream{0, 0, 0, nullptr};
+};
+
+struct effect_primitive {
+    uint32_t primitive_id;
+    uint32_t delay_ms;
+    float scale;
+};
+
 const struct effect_stream* get_effect_stream(uint32_t effect_id);
 
+/*
+ * Returns a single stream playing the given primitives back to back at the play rate of the
+ * first one, each preceded by its delay and scaled by its scale (0.0 to 1.0). Streams are
+ * cached by composition, so repeating a composition is free. Once the cache is full the
+ * stream is composed into storage instead. Returns NULL if a primitive is missing, in which
+ * case callers should play the primitives one by one.
+ */
+const struct effect_stream* get_composed_effect_stream(const struct effect_primitive* primitives,
+                                                       size_t count,
+                                                       struct effect_stream_storage* storage);
+
+/*
+ * Returns the effect with its amplitude scaled (1.0 is unchanged, louder values saturate)
+ * and resampled to play_rate_hz. Results are cached for the lifetime of the process, and
+ * once the cache is full they are written into storage instead.
+ */
+const struct effect_stream* get_scaled_effect_stream(uint32_t effect_id, float amplitude,
+                                                     uint32_t play_rate_hz,
+                                                     struct effect_stream_storage* storage);
+
 #endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "scale.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Reference implementation, the vector paths below must match it bit for bit
+inline int8_t scaleSample(int8_t sample, int16_t gain) {
+    int32_t scaled = (sample * gain + (1 << 6)) >> 7;
+    return static_cast<int8_t>(std::clamp(scaled, -128, 127));
+}
+
+}  // namespace
+
+int16_t amplitudeToGain(float amplitude) {
+    if (!(amplitude > 0.0f)) {
+        return 0;
+    }
+
+    long gain = std::lround(amplitude * kUnityGain);
+    return static_cast<int16_t>(std::min(gain, static_cast<long>(kMaxGain)));
+}
+
+void scaleFifoData(const int8_t* in, int8_t* out, size_t length, int16_t gain) {
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    for (; i + 16 <= length; i += 16) {
+        int8x16_t samples = vld1q_s8(in + i);
+        int16x8_t lo = vmulq_n_s16(vmovl_s8(vget_low_s8(samples)), gain);
+        int16x8_t hi = vmulq_n_s16(vmovl_s8(vget_high_s8(samples)), gain);
+        lo = vrshrq_n_s16(lo, 7);
+        hi = vrshrq_n_s16(hi, 7);
+        vst1q_s8(out + i, vcombine_s8(vqmovn_s16(lo), vqmovn_s16(hi)));
+    }
+#elif defined(__SSE2__)
+    const __m128i vgain = _mm_set1_epi16(gain);
+    const __m128i vround = _mm_set1_epi16(1 << 6);
+    for (; i + 16 <= length; i += 16) {
+        __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        // Sign extend to 16 bits by placing each byte in the high half and shifting down
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(samples, samples), 8);
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(samples, samples), 8);
+        lo = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, vgain), vround), 7);
+        hi = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, vgain), vround), 7);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < length; i++) {
+        out[i] = scaleSample(in[i], gain);
+    }
+}
+
+size_t resampledLength(size_t length, uint32_t fromRateHz, uint32_t toRateHz) {
+    return static_cast<size_t>(((uint64_t)length * toRateHz + fromRateHz - 1) / fromRateHz);
+}
+
+void resampleFifoData(const int8_t* in, size_t length, uint32_t fromRateHz, int8_t* out,
+                      uint32_t toRateHz) {
+    const size_t outLength = resampledLength(length, fromRateHz, toRateHz);
+    // Q16 step through the input per output sample
+    const uint64_t step = ((uint64_t)fromRateHz << 16) / toRateHz;
+
+    uint64_t position = 0;
+    for (size_t i = 0; i < outLength; i++, position += step) {
+        size_t index = std::min(static_cast<size_t>(position >> 16), length - 1);
+        int32_t fraction = static_cast<int32_t>(position & 0xffff);
+        int32_t a = in[index];
+        int32_t b = index + 1 < length ? in[index + 1] : a;
+        out[i] = static_cast<int8_t>(a + (((b - a) * fraction + (1 << 15)) >> 16));
+    }
+}
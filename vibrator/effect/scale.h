@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Unity gain, gains are Q7 fixed point so that sample * gain always fits in 16 bits
+const int16_t kUnityGain = 128;
+const int16_t kMaxGain = 255;
+
+int16_t amplitudeToGain(float amplitude);
+
+// Scale int8 fifo data by a Q7 gain with rounding and saturation, in and out may alias
+void scaleFifoData(const int8_t* in, int8_t* out, size_t length, int16_t gain);
+
+size_t resampledLength(size_t length, uint32_t fromRateHz, uint32_t toRateHz);
+
+// Linearly interpolate fifo data between play rates, out must hold resampledLength() samples
+void resampleFifoData(const int8_t* in, size_t length, uint32_t fromRateHz, int8_t* out,
+                      uint32_t toRateHz);
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <aidl/android/hardware/vibrator/Effect.h>
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "effect.h"
+#include "scale.h"
+
+using aidl::android::hardware::vibrator::Effect;
+
+namespace {
+
+const uint32_t kPrimitiveMask = (1 << 15);
+const uint32_t kPlayRateHz = 24000;
+const int kThreads = 8;
+const int kIterations = 2000;
+
+const uint32_t kEffects[] = {(uint32_t)Effect::CLICK, (uint32_t)Effect::TICK};
+const uint32_t kPrimitives[] = {1, 7};
+
+uint32_t effectLength(uint32_t uniqueEffectId) {
+    return 40 + (uniqueEffectId & 0xff) * 20 + ((uniqueEffectId & kPrimitiveMask) ? 16 : 0);
+}
+
+int8_t effectSample(uint32_t uniqueEffectId, size_t i) {
+    return static_cast<int8_t>(i * 3 + uniqueEffectId * 11);
+}
+
+std::string effectPath(uint32_t uniqueEffectId) {
+    const uint32_t id = uniqueEffectId & ~kPrimitiveMask;
+    return std::string(VIBRATOR_EFFECT_DIR) +
+           ((uniqueEffectId & kPrimitiveMask) ? "/primitive_effect_" : "/effect_") +
+           std::to_string(id) + ".bin";
+}
+
+/*
+ * The library scans its effect directory while it is loaded, so the files have to be in place
+ * before any default priority initializer runs.
+ */
+struct EffectFiles {
+    EffectFiles() {
+        mkdir(VIBRATOR_EFFECT_DIR, 0755);
+
+        std::vector<uint32_t> ids(std::begin(kEffects), std::end(kEffects));
+        for (uint32_t primitive : kPrimitives) {
+            ids.push_back(primitive | kPrimitiveMask);
+        }
+
+        for (uint32_t id : ids) {
+            std::string data(effectLength(id), '\0');
+            for (size_t i = 0; i < data.size(); i++) {
+                data[i] = effectSample(id, i);
+            }
+            android::base::WriteStringToFile(data, effectPath(id));
+        }
+    }
+} sEffectFiles __attribute__((init_priority(101)));
+
+std::vector<int8_t> expectedScaled(uint32_t uniqueEffectId, float amplitude) {
+    std::vector<int8_t> samples(effectLength(uniqueEffectId));
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = effectSample(uniqueEffectId, i);
+    }
+    scaleFifoData(samples.data(), samples.data(), samples.size(), amplitudeToGain(amplitude));
+    return samples;
+}
+
+bool streamEquals(const effect_stream* stream, const std::vector<int8_t>& expected) {
+    return stream && stream->length == expected.size() &&
+           memcmp(stream->data, expected.data(), expected.size()) == 0;
+}
+
+}  // namespace
+
+TEST(EffectStressTest, ConcurrentLookupsSeeCompleteStreams) {
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([t, &failures] {
+            for (int i = 0; i < kIterations; i++) {
+                const uint32_t id = kEffects[(i + t) % std::size(kEffects)];
+                if (!streamEquals(get_effect_stream(id), expectedScaled(id, 1.0f))) {
+                    failures++;
+                }
+
+                // The synthesized double click is published once, whoever asks first
+                const effect_stream* doubleClick =
+                        get_effect_stream((uint32_t)Effect::DOUBLE_CLICK);
+                if (!doubleClick || doubleClick->effect_id != (uint32_t)Effect::DOUBLE_CLICK) {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+}
+
+TEST(EffectStressTest, ConcurrentScalingOutlivesTheCache) {
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([t, &failures] {
+            effect_stream_storage storage;
+            for (int i = 0; i < kIterations; i++) {
+                // Enough distinct gains to fill the cache and spill into storage
+                const uint32_t id = kEffects[i % std::size(kEffects)];
+                const float amplitude = ((i * 7 + t) % 100) / 100.0f;
+                const effect_stream* stream =
+                        get_scaled_effect_stream(id, amplitude, kPlayRateHz, &storage);
+                if (!streamEquals(stream, expectedScaled(id, amplitude))) {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+}
+
+TEST(EffectStressTest, ConcurrentCompositionOutlivesTheCache) {
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([t, &failures] {
+            effect_stream_storage storage;
+            for (int i = 0; i < kIterations; i++) {
+                // Enough distinct compositions to fill the cache and spill into storage
+                const float scale = ((i * 13 + t) % 200) / 200.0f;
+                const effect_primitive primitives[] = {
+                        {kPrimitives[0], 0, 1.0f},
+                        {kPrimitives[1], 1, scale},
+                };
+
+                std::vector<int8_t> expected =
+                        expectedScaled(kPrimitives[0] | kPrimitiveMask, 1.0f);
+                expected.resize(expected.size() + kPlayRateHz / 1000, 0);
+                std::vector<int8_t> second =
+                        expectedScaled(kPrimitives[1] | kPrimitiveMask, scale);
+                expected.insert(expected.end(), second.begin(), second.end());
+
+                const effect_stream* stream =
+                        get_composed_effect_stream(primitives, std::size(primitives), &storage);
+                if (!streamEquals(stream, expected) ||
+                    stream->effect_id != (kPrimitives[0] | kPrimitiveMask)) {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+}
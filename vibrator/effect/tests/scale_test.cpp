@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "scale.h"
+
+namespace {
+
+// Written out independently of scale.cpp: Q7 multiply, round half up, saturate
+int8_t referenceScale(int8_t sample, int16_t gain) {
+    int32_t scaled = (sample * gain + 64) >> 7;
+    return static_cast<int8_t>(std::clamp(scaled, -128, 127));
+}
+
+// Every int8 sample, repeated so that both the vector body and the scalar tail see them
+std::vector<int8_t> allSamples(size_t length) {
+    std::vector<int8_t> samples(length);
+    for (size_t i = 0; i < length; i++) {
+        samples[i] = static_cast<int8_t>(i * 7 + 3);
+    }
+    return samples;
+}
+
+}  // namespace
+
+TEST(ScaleFifoDataTest, MatchesReferenceForEveryGain) {
+    // Not a multiple of the 16 sample vector width, so the scalar tail runs too
+    const std::vector<int8_t> in = allSamples(256 * 4 + 13);
+    std::vector<int8_t> out(in.size());
+
+    for (int gain = 0; gain <= kMaxGain; gain++) {
+        scaleFifoData(in.data(), out.data(), in.size(), gain);
+        for (size_t i = 0; i < in.size(); i++) {
+            ASSERT_EQ(out[i], referenceScale(in[i], gain))
+                    << "sample " << static_cast<int>(in[i]) << " gain " << gain;
+        }
+    }
+}
+
+TEST(ScaleFifoDataTest, VectorPathMatchesScalarPath) {
+    const std::vector<int8_t> in = allSamples(4096);
+    std::vector<int8_t> vectorOut(in.size());
+    std::vector<int8_t> scalarOut(in.size());
+
+    for (int gain = 0; gain <= kMaxGain; gain++) {
+        scaleFifoData(in.data(), vectorOut.data(), in.size(), gain);
+        // Calls shorter than the vector width only take the scalar path
+        for (size_t i = 0; i < in.size(); i++) {
+            scaleFifoData(&in[i], &scalarOut[i], 1, gain);
+        }
+        ASSERT_EQ(vectorOut, scalarOut) << "gain " << gain;
+    }
+}
+
+TEST(ScaleFifoDataTest, ScalesInPlace) {
+    const std::vector<int8_t> in = allSamples(1000);
+    std::vector<int8_t> expected(in.size());
+    scaleFifoData(in.data(), expected.data(), in.size(), 200);
+
+    std::vector<int8_t> inPlace = in;
+    scaleFifoData(inPlace.data(), inPlace.data(), inPlace.size(), 200);
+    EXPECT_EQ(inPlace, expected);
+}
+
+TEST(ScaleFifoDataTest, UnityGainIsIdentity) {
+    const std::vector<int8_t> in = allSamples(777);
+    std::vector<int8_t> out(in.size());
+    scaleFifoData(in.data(), out.data(), in.size(), kUnityGain);
+    EXPECT_EQ(out, in);
+}
+
+TEST(ResampleFifoDataTest, SameRateIsIdentity) {
+    const std::vector<int8_t> in = allSamples(500);
+    ASSERT_EQ(resampledLength(in.size(), 24000, 24000), in.size());
+
+    std::vector<int8_t> out(in.size());
+    resampleFifoData(in.data(), in.size(), 24000, out.data(), 24000);
+    EXPECT_EQ(out, in);
+}
+
+TEST(ResampleFifoDataTest, InterpolatesBetweenSamples) {
+    const std::vector<int8_t> in = {0, 100, -100};
+    ASSERT_EQ(resampledLength(in.size(), 12000, 24000), 6u);
+
+    std::vector<int8_t> out(6);
+    resampleFifoData(in.data(), in.size(), 12000, out.data(), 24000);
+    EXPECT_EQ(out, (std::vector<int8_t>{0, 50, 100, 0, -100, -100}));
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2024 The LineageOS Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bundle.h"
+
+namespace {
+
+const uint32_t kDefaultPlayRateHz = 24000;
+const uint32_t kPrimitiveMask = (1 << 15);
+
+struct Effect {
+    effect_bundle_entry entry;
+    std::vector<uint8_t> data;
+};
+
+bool parseEffectFileName(std::string name, uint32_t* uniqueEffectId) {
+    uint32_t mask = 0;
+
+    if (name.rfind("primitive_effect_", 0) == 0) {
+        mask = kPrimitiveMask;
+        name.erase(0, strlen("primitive_effect_"));
+    } else if (name.rfind("effect_", 0) == 0) {
+        name.erase(0, strlen("effect_"));
+    } else {
+        return false;
+    }
+
+    if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".bin") != 0) {
+        return false;
+    }
+    name.erase(name.size() - 4);
+
+    if (name.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+
+    unsigned long effectId = strtoul(name.c_str(), nullptr, 10);
+    if (effectId >= kPrimitiveMask) {
+        return false;
+    }
+
+    *uniqueEffectId = static_cast<uint32_t>(effectId) | mask;
+    return true;
+}
+
+void usage(const char* name) {
+    std::cerr << "Usage: " << name << " [--rate <hz>] <effect dir> <output bundle>"
+              << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    uint32_t playRateHz = kDefaultPlayRateHz;
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            playRateHz = strtoul(argv[++i], nullptr, 10);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+
+    if (args.size() != 2 || playRateHz == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Effect> effects;
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(args[0], ec)) {
+        uint32_t uniqueEffectId;
+        if (!file.is_regular_file() ||
+            !parseEffectFileName(file.path().filename().string(), &uniqueEffectId)) {
+            continue;
+        }
+
+        std::ifstream in(file.path(), std::ios::in | std::ios::binary);
+        std::vector<uint8_t> samples((std::istreambuf_iterator<char>(in)),
+                                     std::istreambuf_iterator<char>());
+        if (samples.empty()) {
+            std::cerr << "Skipping empty " << file.path() << std::endl;
+            continue;
+        }
+
+        Effect effect = {};
+        effect.entry.effect_id = uniqueEffectId;
+        effect.entry.play_rate_hz = playRateHz;
+        effect.entry.length = samples.size();
+        effect.entry.encoding = EFFECT_BUNDLE_ENCODING_RAW;
+        effect.data = std::move(samples);
+        effect.entry.encoded_length = effect.data.size();
+        effects.push_back(std::move(effect));
+    }
+
+    if (ec) {
+        std::cerr << "Failed to read " << args[0] << ": " << ec.message() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::sort(effects.begin(), effects.end(), [](const Effect& a, const Effect& b) {
+        return a.entry.effect_id < b.entry.effect_id;
+    });
+
+    effect_bundle_header header = {
+            .magic = EFFECT_BUNDLE_MAGIC,
+            .version = EFFECT_BUNDLE_VERSION,
+            .header_size = sizeof(effect_bundle_header),
+            .count = static_cast<uint32_t>(effects.size()),
+            .entry_size = sizeof(effect_bundle_entry),
+    };
+
+    uint64_t offset = sizeof(header) + effects.size() * sizeof(effect_bundle_entry);
+    for (Effect& effect : effects) {
+        effect.entry.offset = offset;
+        offset += effect.data.size();
+    }
+
+    if (offset > UINT32_MAX) {
+        std::cerr << "Bundle too large" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream out(args[1], std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const Effect& effect : effects) {
+        out.write(reinterpret_cast<const char*>(&effect.entry), sizeof(effect.entry));
+    }
+    for (const Effect& effect : effects) {
+        out.write(reinterpret_cast<const char*>(effect.data.data()), effect.data.size());
+    }
+
+    if (!out) {
+        std::cerr << "Failed to write " << args[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Packed " << effects.size() << " effects into " << args[1] << " (" << offset
+              << " bytes)" << std::endl;
+    return EXIT_SUCCESS;
+}